@@ -5,46 +5,294 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <ctype.h>
 #include "mv_ucode.h"
+#include "mv_ir.h"
 
 #define dprintf(...) if(debug) fprintf (stderr, __VA_ARGS__)
 
+/*
+ * C expression for the value of node n, a vector of lanes with simd
+ */
+static const char *gen_val(const mvir *ir, int n, const char *inx, int simd)
+{
+	static char buf[4][24];
+	static int next;
+	char *s = buf[next++ & 3];
+	
+	switch(ir->node[n].kind)
+	{
+		case IR_ADC:
+			return inx;
+	
+		case IR_ACCIN:
+			return "acc";
+	
+		case IR_CONST:
+			snprintf(s, 24, simd ? "v_set1(%d)" : "(%d)", ir->node[n].k);
+			return s;
+	
+		default:
+			snprintf(s, 16, "v%d", n);
+			return s;
+	}
+}
+
+/*
+ * does any live node take the input sample
+ */
+static int gen_reads_in(const mvir *ir, const int *order, int cnt)
+{
+	const mvnode *p;
+	int k;
+	
+	for(k=0;k<cnt;k++)
+	{
+		p = &ir->node[order[k]];
+		if(p->dead)
+			continue;
+		if(((p->a >= 0) && (ir->node[p->a].kind == IR_ADC)) ||
+			((p->b >= 0) && (ir->node[p->b].kind == IR_ADC)))
+			return 1;
+	}
+	
+	return 0;
+}
+
+/*
+ * sort offsets
+ */
+static int gen_cmp(const void *a, const void *b)
+{
+	return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+/*
+ * prefetch the words pfd samples ahead of the loads, one per cache line,
+ * or per word when each is a vector of lanes
+ */
+static void gen_prefetch(FILE *ofile, const mvir *ir, const char *tab,
+	int pfd, int simd)
+{
+	uint16_t off[MVIR_MAXN];
+	int i, n = 0, last = -1;
+	
+	for(i=0;i<ir->n;i++)
+		if(!ir->node[i].dead && (ir->node[i].kind == IR_LOAD))
+			off[n++] = ir->node[i].off;
+	if(!n)
+		return;
+	qsort(off, n, sizeof(uint16_t), gen_cmp);
+	
+	fprintf(ofile, "%sconst %s *pf = mem + ((addr+0x%04X)&0x3fff);\n",
+		tab, simd ? "mvvec" : "int16_t", (pfd*ir->sum)&0x3fff);
+	fprintf(ofile, "%s", tab);
+	for(i=0;i<n;i++)
+	{
+		/* 64 byte lines */
+		if((last >= 0) && (off[i] < last + (simd ? 1 : 32)))
+			continue;
+		fprintf(ofile, "MV_PREFETCH(pf+0x%04X); ", off[i]);
+		last = off[i];
+	}
+	fprintf(ofile, "// prefetch\n");
+}
+
+/*
+ * emit the body of one sample from the cnt IR nodes in order, one line per
+ * instruction with anything left in it. With absol loads and stores are at
+ * constant offsets from m, the sample's base in the mirrored DRAM, and
+ * pfd > 0 prefetches the taps that many samples ahead. With simd every
+ * value and DRAM word is an mvvec of lanes, see mv_simd.h.
+ */
+static void gen_prog(FILE *ofile, const mvir *ir, const int *order, int cnt,
+	uint16_t optbits, const char *tab, const char *inx, const char *outlx,
+	const char *outrx, int absol, int pfd, int simd)
+{
+	const char *ty = simd ? "mvvec" : "int16_t";
+	const mvnode *p;
+	const char *a, *b;
+	uint16_t cur = 0;
+	int i, k, line = -1;
+	
+	if(absol)
+	{
+		fprintf(ofile, "%s%s *m = mem + addr;\n", tab, ty);
+		if(pfd > 0)
+			gen_prefetch(ofile, ir, tab, pfd, simd);
+	}
+	for(k=0;k<cnt;k++)
+	{
+		i = order[k];
+		p = &ir->node[i];
+		if(p->dead || (p->kind == IR_ADC) || (p->kind == IR_ACCIN) ||
+			(p->kind == IR_CONST))
+			continue;
+	
+		/* new line for each instruction */
+		if(p->instr != line)
+		{
+			if(line >= 0)
+				fprintf(ofile, "// %d\n", line);
+			fprintf(ofile, "%s", tab);
+			line = p->instr;
+		}
+	
+		/* walk the address to the word */
+		if(!absol && ((p->kind == IR_LOAD) || (p->kind == IR_STORE)) &&
+			(p->off != cur))
+		{
+			fprintf(ofile, "addr=(addr+0x%04X)&0x3fff; ",
+				(p->off - cur)&0x3fff);
+			cur = p->off;
+		}
+	
+		a = p->a >= 0 ? gen_val(ir, p->a, inx, simd) : NULL;
+		b = p->b >= 0 ? gen_val(ir, p->b, inx, simd) : NULL;
+		switch(p->kind)
+		{
+			case IR_LOAD:
+				if(absol)
+					fprintf(ofile, "%s v%d=m[0x%04X]; ", ty, i, p->off);
+				else
+					fprintf(ofile, "%s v%d=mem[addr]; ", ty, i);
+				break;
+	
+			case IR_NOT:
+				/* fast math negates in both backends, so they agree */
+				if(simd && (optbits & MVIR_FAST))
+					fprintf(ofile, "mvvec v%d=v_sub(v_set1(0), %s); ", i, a);
+				else if(simd)
+					fprintf(ofile, "mvvec v%d=v_xor(%s, v_set1(-1)); ", i, a);
+				else
+					fprintf(ofile, "int16_t v%d=%c%s; ", i,
+						(optbits & MVIR_FAST) ? '-' : '~', a);
+				break;
+	
+			case IR_HALF:
+				if(simd && (optbits & MVIR_FAST))
+					fprintf(ofile, "mvvec v%d=v_sra(%s, 1); ", i, a);
+				else if(simd)
+					fprintf(ofile, "mvvec v%d=v_add(v_sra(%s, 1), "
+						"v_srl(%s, 15)); ", i, a, a);
+				else if(optbits & MVIR_FAST)
+					fprintf(ofile, "int16_t v%d=%s>>1; ", i, a);
+				else
+					fprintf(ofile, "int16_t v%d=(%s>>1)+((%s>>15)&1); ", i,
+						a, a);
+				break;
+	
+			case IR_UNITY:
+				if(optbits & MVIR_FAST)
+					fprintf(ofile, "%s v%d=%s; ", ty, i, a);
+				else if(simd)
+					fprintf(ofile, "mvvec v%d=v_add(v_and(%s, v_set1(-2)), "
+						"v_sll(v_srl(%s, 15), 1)); ", i, a, a);
+				else
+					fprintf(ofile, "int16_t v%d=(%s&~1)+2*((%s>>15)&1); ", i,
+						a, a);
+				break;
+	
+			case IR_ADD:
+				if(simd)
+					fprintf(ofile, "mvvec v%d=v_add(%s, %s); ", i, a, b);
+				else
+					fprintf(ofile, "int16_t v%d=%s+%s; ", i, a, b);
+				break;
+	
+			case IR_STORE:
+				if(absol)
+					fprintf(ofile, "MV_ST(0x%04X, %s); ", p->off, a);
+				else
+					fprintf(ofile, "mem[addr]=%s; ", a);
+				break;
+	
+			case IR_DAC:
+				fprintf(ofile, "%s=%s; ", p->off ? outrx : outlx, a);
+				break;
+	
+			case IR_ACCOUT:
+				fprintf(ofile, "acc=%s; ", a);
+				break;
+		}
+	}
+	if(line >= 0)
+		fprintf(ofile, "// %d\n", line);
+	
+	/* on to the next sample's base */
+	if(ir->sum != cur)
+		fprintf(ofile, "%saddr=(addr+0x%04X)&0x3fff;\n", tab,
+			(ir->sum - cur)&0x3fff);
+}
+
 int main(int argc, char **argv)
 {
 	uint8_t prog, pstart = 0, pend = 62;
-	char *oname = "mv_progs.c";
-	FILE *ofile;
-	uint8_t discard, routinst = 0x60, loutinst = 0x70, acnt;
-	uint16_t *iptr, i, j, op[128], addr[128], asum[129], raddr, laddr;
+	char *oname = "mv_progs.c", hname[256], *tab = "\t";
+	const char *inx = "in", *outlx = "*outl", *outrx = "*outr";
+	FILE *ofile, *hfile;
+	uint16_t i, j;
 	int32_t c;
-	uint16_t optbits = 0x00ff;
-	uint8_t debug = 0;
+	uint16_t optbits = 0x03ff;
+	uint8_t debug = 0, reent = 0, absol = 0, simd = 0;
+	int verify = 20000, pfd = -1, sched = 0, order[MVIR_MAXN], cnt, before;
+	static mvir ir;
 	
 	/* parse options */
 	opterr = 0;
 
-	while((c = getopt (argc, argv, "d:O:o:p:")) != -1)
+	while((c = getopt (argc, argv, "ad:O:o:P:p:rs:vV:")) != -1)
 	{
 		switch(c)
 		{
+			case 'a':
+				/* absolute offsets from the base in a mirrored DRAM */
+				absol = 1;
+				break;
+			
 			case 'd':
 				debug = atoi(optarg);
 				break;
 			
 			case 'O':
-				optbits = atoi(optarg);
+				optbits = strtol(optarg, NULL, 0);
+				break;
+			
+			case 'V':
+				/* samples each pass is checked over, 0 for none */
+				verify = atoi(optarg);
 				break;
 			
 			case 'o':
 				oname = optarg;
 				break;
 			
+			case 'P':
+				/* prefetch distance in samples with -a, 0 for none */
+				pfd = atoi(optarg);
+				break;
+			
 			case 'p':
 				pstart = pend = atoi(optarg);
 				break;
 			
+			case 'r':
+				/* reentrant, state struct & block of frames per call */
+				reent = 1;
+				break;
+			
+			case 's':
+				/* interleave the acc chains for a core of this width */
+				sched = atoi(optarg);
+				break;
+			
+			case 'v':
+				/* reentrant, on a vector of streams per call */
+				reent = simd = 1;
+				break;
+			
 			case '?':
 				if(optopt == 'b')
 					fprintf (stderr, "Option -%c requires a filename.\n", optopt);
@@ -64,6 +312,8 @@ int main(int argc, char **argv)
 	}
 	
 	/* open output file */
+	if(simd && !strcmp(oname, "mv_progs.c"))
+		oname = "mv_progs_simd.c";
 	if(!(ofile = fopen(oname, "w")))
 	{
 		fprintf(stderr, "Couldn't open %s for output\n", oname);
@@ -74,347 +324,143 @@ int main(int argc, char **argv)
 	fprintf(ofile, "/*\n");
 	fprintf(ofile, " * %s - auto-generated C code for Midiverb programs\n", oname);
 	fprintf(ofile, " */\n");
-	fprintf(ofile, "#include <stdint.h>\n");
-	fprintf(ofile, "uint16_t addr;\n");
-	fprintf(ofile, "int16_t acc, mem[16384];\n");
-
-	/* loop over all programs */
-	for(prog = pstart;prog <= pend;prog++)
+	if(reent)
 	{
-		dprintf("Program %d\n", prog);
-		acnt = 0;
-		
-		/* load prog for analysis */
-		iptr = &mv_ucode[prog*128];
-		for(i=0;i<128;i++)
+		/* state lives in a header next to the code so callers can hold it */
+		snprintf(hname, sizeof(hname), "%.*s.h", (int)(strlen(oname) -
+			(strrchr(oname, '.') ? strlen(strrchr(oname, '.')) : 0)), oname);
+		if(!(hfile = fopen(hname, "w")))
 		{
-			/* get operation & address offset */
-			op[i] = (*iptr >> 14)&3;
-			addr[i] = *iptr++ & 0x3fff;
+			fprintf(stderr, "Couldn't open %s for output\n", hname);
+			fclose(ofile);
+			exit(1);
 		}
-		
-		/* disable acc at fixed special addrs */
-		op[0x00] |= 4; // no acc outputs on addr 0x00
-		op[0x60] |= 4; // no acc outputs on addr 0x60
-		op[0x70] |= 4; // no acc outputs on addr 0x70
-		
-		if(optbits & 1)
+		fprintf(hfile, "/*\n");
+		fprintf(hfile, " * %s - auto-generated state for reentrant Midiverb programs\n", hname);
+		fprintf(hfile, " */\n");
+		fprintf(hfile, "#ifndef __mv_progs__\n");
+		fprintf(hfile, "#define __mv_progs__\n");
+		fprintf(hfile, "#include <stdint.h>\n");
+		fprintf(hfile, "#include <stddef.h>\n");
+		if(simd)
 		{
-			/*--------------------------------------------------------------*/
-			/* Detect and Remove trailing NOPs                              */
-			/*--------------------------------------------------------------*/
-			/* search forward from zero to see if previous acc is ever used */
-			discard = 1;
-			for(i=0;i<128;i++)
-			{
-				if(!(op[i]&4)&&(op[i]&2))
-				{
-					discard = 0;
-					fprintf(stderr, "Warning: Prev acc used @ op %d\n", i);
-				}
-				else if(!(op[i]&4)&&(op[i]&1))
-				{
-					dprintf("Prev acc discarded @ op %d\n", i);				
-					break;
-				}
-			}
-			
-			/* Substitute NOPs */
-			if(discard)
-			{
-				for(i=127;i>0;i--)
-				{
-					if(!(op[i]&4) && (op[i]&2))
-						break;	// not DAC and write operation so acc was used
-					else
-						op[i] |= 4;	// otherwise unused so NOP
-				}
-				dprintf("NOPed final %d acc instrs\n", 127-i);
-			}
+			/* the lane count follows the vector width it's compiled for */
+			fprintf(hfile, "#include \"mv_simd.h\"\n");
+			fprintf(hfile, "/* MV_VLEN streams per call, in is [frame][lane] and out [frame][lane][L/R]. */\n");
+			fprintf(hfile, "/* mv_state must be aligned to an mvvec, i.e. static or aligned_alloc(). */\n");
 		}
+		fprintf(hfile, "typedef struct {\n");
+		fprintf(hfile, "\tuint16_t addr;\n");
+		fprintf(hfile, "\t%s acc;\n", simd ? "mvvec" : "int16_t");
+		fprintf(hfile, "\t%s mem[%d];\n", simd ? "mvvec" : "int16_t",
+			absol ? 32768 : 16384);
+		fprintf(hfile, "} mv_state;\n");
+		fprintf(hfile, "extern void (*mv_progs[63])(mv_state *, const int16_t *, int16_t *, size_t);\n");
+		fprintf(hfile, "#endif\n");
+		fclose(hfile);
 		
-		/* determine address offsets for each instr */
-		asum[0] = 0;
-		for(i=0;i<128;i++)
-			asum[i+1] = (asum[i] + addr[i])&0x3fff;
-		if(asum[128] != 1)
-			fprintf(stderr, "Warning: offset sum = %d\n", asum[128]);
+		fprintf(ofile, "#include \"%s\"\n", strrchr(hname, '/') ?
+			strrchr(hname, '/') + 1 : hname);
+		tab = "\t\t";
+		inx = simd ? "v_load(&in[MV_VLEN*n])" : "in[n]";
+		outlx = simd ? "vl" : "out[2*n]";
+		outrx = simd ? "vr" : "out[2*n+1]";
+	}
+	else
+	{
+		fprintf(ofile, "#include <stdint.h>\n");
+		fprintf(ofile, "uint16_t addr;\n");
+		fprintf(ofile, "int16_t acc, mem[%d];\n", absol ? 32768 : 16384);
+	}
+	if(absol)
+	{
+		/* the upper half mirrors the lower, so base+off never wraps */
+		fprintf(ofile, "#ifndef MV_PREFETCH\n");
+		fprintf(ofile, "#define MV_PREFETCH(p) __builtin_prefetch(p)\n");
+		fprintf(ofile, "#endif\n");
+		fprintf(ofile, "#define MV_ST(o,v) (m[o]=mem[(addr+(o))^0x4000]=(v))\n");
 		
-		if(optbits & 2)
-		{
-			/*--------------------------------------------------------------*/
-			/* Simplify Outputs                                             */
-			/*--------------------------------------------------------------*/
-			/* get addr where R & L outputs are read from */
-			raddr = asum[0x60];
-			laddr = asum[0x70];
-			
-			/* search for where those are written */
-			for(i=1;i<128;i++)
-			{
-				if(i!=0x60)
-				{
-					if(asum[i] == raddr)
-					{
-						dprintf("raddr 0x%04X is %s @ instr 0x%02X\n", raddr,
-							op[i]&2?"written":"read", i);
-						if(op[i]&2)
-						{
-							routinst = i;
-						}
-					}
-				}
-				if(i!=0x70)
-				{			
-					if(asum[i] == laddr)
-					{
-						dprintf("laddr 0x%04X is %s @ instr 0x%02X\n", laddr,
-							op[i]&2?"written":"read", i);
-						if(op[i]&2)
-						{
-							loutinst = i;
-						}
-					}
-				}
-			}
-			
-			/* simplify addressing if things were moved */
-			if(routinst != 0x60)
-			{
-				dprintf("rout moved to instr 0x%02X\n", routinst);
-				addr[0x5f] = (addr[0x5f] + addr[0x60]) & 0x3fff;
-				addr[0x60] = 0;
-			}
-			if(loutinst != 0x70)
-			{
-				dprintf("lout moved to instr 0x%02X\n", loutinst);
-				addr[0x6f] = (addr[0x6f] + addr[0x70]) & 0x3fff;
-				addr[0x70] = 0;
-			}
-		}
+		/* the next sample's taps by default */
+		pfd = pfd < 0 ? 1 : pfd;
+	}
 
-		if(optbits & 4)
+	/* loop over all programs */
+	for(prog = pstart;prog <= pend;prog++)
+	{
+		dprintf("Program %d\n", prog);
+		
+		/* build the dataflow IR & run the passes over it */
+		if(mvir_Build(&ir, prog, &mv_ucode[prog*128]) ||
+			mvir_Optimize(&ir, &mv_ucode[prog*128], optbits, verify, debug))
 		{
-			/*--------------------------------------------------------------*/
-			/* remove dead-end acc ops                                      */
-			/*--------------------------------------------------------------*/
-			discard = 1;
-			for(i=127;i>1;i--)
-			{
-				if(discard)
-				{
-					dprintf("Removed dead-end acc op @ instr %d\n", i);
-					op[i] |= 4;
-					if(op[i]&2)
-						discard = 0;
-				}
-				else if((op[i]&3)==1)
-					discard = 1;
-			}
+			fprintf(stderr, "Program %d doesn't fit\n", prog);
+			fclose(ofile);
+			exit(1);
 		}
+		if(ir.sum != 1)
+			fprintf(stderr, "Warning: offset sum = %d\n", ir.sum);
+		dprintf("%d dead stores, %d ops removed across samples\n",
+			ir.xstores, ir.xops);
 		
-		if(optbits & 16)
+		/* microcode order, or scheduled */
+		for(cnt=i=0;i<ir.n;i++)
+			if(!ir.node[i].dead)
+				order[cnt++] = i;
+		if(sched > 0)
 		{
-			/*--------------------------------------------------------------*/
-			/* collapse unity accum reads                                   */
-			/*--------------------------------------------------------------*/
-			discard = 0;
-			for(i=0;i<128;i++)
-			{
-				if(discard == 0)
-				{
-					//if(((op[i]==0) || (op[i]==1)) && (addr[i]==0)) // doesn't work
-					if((op[i]==0) && (addr[i]==0))
-						discard = 1;
-				}
-				else
-				{
-					if(op[i] == 0)
-					{
-						dprintf("Unity acc read @ instr %d\n", i);
-						op[i-1] |= 4;
-						op[i] = 8;
-					}
-					discard = 0;
-				}
-			}
+			/* in order at this width, as the code is written either way */
+			before = mvir_Issue(&ir, order, cnt, sched, !absol);
+			cnt = mvir_Schedule(&ir, sched, order);
+			fprintf(stderr, "Program %d: %d chains, %d-wide in order %d -> "
+				"%d cycles\n", prog, mvir_Chains(&ir), sched, before,
+				mvir_Issue(&ir, order, cnt, sched, !absol));
 		}
-
-		if(optbits & 32)
+		
+		/* start prog */
+		if(ir.xstores)
+			fprintf(ofile, "/* %d stores nothing reads, %d ops only they "
+				"used */\n", ir.xstores, ir.xops);
+		if(reent)
 		{
-			/*--------------------------------------------------------------*/
-			/* collapse unity clear reads                                   */
-			/*--------------------------------------------------------------*/
-			discard = 0;
-			for(i=0;i<128;i++)
-			{
-				if(discard == 0)
-				{
-					if((op[i]==1) && (addr[i]==0))
-						discard = 1;
-				}
-				else
-				{
-					if(op[i] == 0)
-					{
-						dprintf("Unity clear read @ instr %d\n", i);
-						op[i-1] |= 4;
-						op[i] = 9;
-					}
-					discard = 0;
-				}
-			}
+			/* acc & addr in registers across the block */
+			fprintf(ofile, "void prog%02d(mv_state *restrict st, const int16_t *restrict in, int16_t *restrict out, size_t frames) {\n", prog);
+			fprintf(ofile, "\tuint16_t addr = st->addr;\n");
+			fprintf(ofile, "\t%s acc = st->acc, *restrict mem = st->mem;\n",
+				simd ? "mvvec" : "int16_t");
+			fprintf(ofile, "\tsize_t n;\n");
+			if(!gen_reads_in(&ir, order, cnt))
+				fprintf(ofile, "\t(void)in;\n");
+			fprintf(ofile, "\tfor(n=0;n<frames;n++) {\n");
+			if(simd)
+				fprintf(ofile, "\t\tmvvec vl, vr;\n");
 		}
-
-		if(optbits & 64)
+		else
 		{
-			/*--------------------------------------------------------------*/
-			/* remove redundant writes                                      */
-			/*--------------------------------------------------------------*/
-			discard = 0;
-			for(i=127;i>0;i--)
-			{
-				if(discard == 0)
-				{
-					if((op[i] & 2) && (addr[i-1] == 0))
-						discard = 1;
-				}
-				else
-				{
-					if(op[i] & 2)
-					{
-						dprintf("Discard redundant write @ instr %d\n", i);
-						op[i] = 12 + (op[i] & 1);
-					}
-					if(addr[i-1] != 0)
-						discard = 0;
-				}
-			}
+			fprintf(ofile, "void prog%02d(int16_t in, int16_t *outl, int16_t *outr) {\n", prog);
+			if(!gen_reads_in(&ir, order, cnt))
+				fprintf(ofile, "\t(void)in;\n");
 		}
-
-		/* start prog */
-		fprintf(ofile, "void prog%02d(int16_t in, int16_t *outl, int16_t *outr) {\n", prog);
 		
-		/* loop over all instructions, decode and output */
-		asum[0] = 0;
-		for(i=0;i<128;i++)
-		{
-			/* start line */
-			fprintf(ofile, "\t");
-			
-			/* decode operation */
-			if(i==0)
-			{
-				/* always write input to current address on instr 0 */
-				fprintf(ofile, "mem[addr]=in; ");
-			}
-			else if(i==0x60)
-			{
-				if(routinst==i)
-				{
-					/* default loc, so always read from mem to right out */
-					fprintf(ofile, "*outr = mem[addr]; ");
-				}
-			}
-			else if(i==0x70)
-			{
-				if(loutinst==i)
-				{
-					/* default loc, so always read from mem to left out */
-					fprintf(ofile, "*outl = mem[addr]; ");
-				}
-			}
-			else
-			{
-				/* handle writes */
-				if(op[i] & 2)
-				{
-					if(i==routinst)
-						if(optbits & 8)
-							fprintf(ofile, "*outr=%cacc; ", op[i]&1?'-':' ');
-						else	
-							fprintf(ofile, "*outr=%cacc; ", op[i]&1?'~':' ');
-					else if(i==loutinst)
-						if(optbits & 8)
-							fprintf(ofile, "*outl=%cacc; ", op[i]&1?'-':' ');
-						else
-							fprintf(ofile, "*outl=%cacc; ", op[i]&1?'~':' ');
-					else
-						if(optbits & 8)
-							fprintf(ofile, "mem[addr]=%cacc; ", op[i]&1?'-':' ');
-						else
-							fprintf(ofile, "mem[addr]=%cacc; ", op[i]&1?'~':' ');
-				}
-				
-				/* decode acc operation */
-				switch(op[i])
-				{
-					case 0:
-						if(optbits & 8)
-							fprintf(ofile, "acc=acc+(mem[addr]>>1); ");
-						else
-							fprintf(ofile, "acc=acc+(mem[addr]>>1)+((mem[addr]>>15)&1); ");
-						break;
-					
-					case 1:
-						if(optbits & 8)
-							fprintf(ofile, "acc=(mem[addr]>>1); ");
-						else
-							fprintf(ofile, "acc=(mem[addr]>>1)+((mem[addr]>>15)&1); ");
-						break;
-					
-					case 2:
-					case 12:
-						if(optbits & 8)
-							fprintf(ofile, "acc=acc+(acc>>1); ");
-						else
-							fprintf(ofile, "acc=acc+(acc>>1)+((acc>>15)&1); ");
-						break;
-					
-					case 3:
-					case 13:
-						if(optbits & 8)
-							fprintf(ofile, "acc=((-acc)>>1); ");
-						else
-							fprintf(ofile, "acc=((~acc)>>1)+(((~acc)>>15)&1); ");
-						break;
-					
-					case 8:
-						/* unity acc */
-						fprintf(ofile, "acc=acc+mem[addr]; ");
-						break;
-
-					case 9:
-						/* unity clr */
-						fprintf(ofile, "acc=mem[addr]; ");
-						break;
-
-					default:
-						break;
-				}
-			}
-			
-			/* update address */
-			if(addr[i])
-				fprintf(ofile, "addr=(addr+0x%04X)&0x3fff;", addr[i]);
-			else
-				acnt++;
-
-			asum[i+1] = (asum[i] + addr[i])&0x3fff;
-			
-			fprintf(ofile, " // %d\n", i);
-		}
+		gen_prog(ofile, &ir, order, cnt, optbits, tab, inx, outlx, outrx,
+			absol, pfd, simd);
 		
 		/* end prog */
+		if(simd)
+			fprintf(ofile, "\t\tv_store2(&out[2*MV_VLEN*n], vl, vr);\n");
+		if(reent)
+		{
+			fprintf(ofile, "\t}\n");
+			fprintf(ofile, "\tst->addr = addr;\n");
+			fprintf(ofile, "\tst->acc = acc;\n");
+		}
 		fprintf(ofile, "}\n\n");
-		
-		dprintf("Removed %d null addres ops\n", acnt);
-		if(asum[128]!=1)
-			fprintf(stderr, "Warning: Final Offset sum = %d\n", asum[128]);
 	}
 	
 	/* generate an array of function pointers to all the programs */
-	fprintf(ofile, "void (*mv_progs[63])(int16_t, int16_t *, int16_t *) = {\n");
+	if(reent)
+		fprintf(ofile, "void (*mv_progs[63])(mv_state *, const int16_t *, int16_t *, size_t) = {\n");
+	else
+		fprintf(ofile, "void (*mv_progs[63])(int16_t, int16_t *, int16_t *) = {\n");
 	j=pstart;
 	for(i=0;i<63;i++)
 	{
@@ -0,0 +1,1034 @@
+/*
+ * mv_ir.c - dataflow IR and verified optimization passes for mv_gencode
+ * 10-17-26 E. Brombaugh
+ *
+ * A program's sample is built into a list of nodes, one value each, in
+ * microcode order. The accumulator disappears into the chains of HALF and
+ * ADD nodes that feed each read of it, and every DRAM access is a LOAD or
+ * STORE at a fixed offset from the sample base, so two of them touch the
+ * same word exactly when their offsets match. Passes rewrite nodes in
+ * place and only ever point operands at earlier nodes, so the list stays
+ * in order for the interpreter here and for the emitter.
+ *
+ * After each pass that changes something the program is run on the IR
+ * and on the raw microcode, from the same state and with the same input,
+ * and any difference in the outputs or the final DRAM undoes the pass.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mv_ir.h"
+
+#define dprintf(...) if(debug) fprintf (stderr, __VA_ARGS__)
+
+/* a pass returns how many changes it made */
+typedef struct
+{
+	const char *name;
+	uint16_t bits;					/* any of these enable it */
+	int (*fn)(mvir *ir);
+	uint8_t mem;					/* leaves the DRAM as the microcode does */
+} mvpass;
+
+/* reference run the passes are checked against */
+typedef struct
+{
+	int samples;
+	int mem;						/* compare the final DRAM too */
+	int16_t *out;					/* 2 per sample, L then R */
+	mvirst ref;						/* state at the end of the run */
+	mvirst st;						/* scratch for the IR's run */
+} mvcheck;
+
+/*
+ * append a node, returns its index or -1 if full
+ */
+static int mvir_Add(mvir *ir, uint8_t kind, uint8_t instr, uint16_t off,
+	int a, int b)
+{
+	mvnode *p;
+	
+	if(ir->n == MVIR_MAXN)
+		return -1;
+	p = &ir->node[ir->n];
+	memset(p, 0, sizeof(mvnode));
+	p->kind = kind;
+	p->instr = instr;
+	p->chain = ir->chains;
+	p->off = off;
+	p->a = a;
+	p->b = b;
+	
+	return ir->n++;
+}
+
+/*
+ * build the IR of one program from its 128 words of microcode, returns 1
+ * if it doesn't fit
+ */
+int mvir_Build(mvir *ir, int prog, const uint16_t *ucode)
+{
+	uint16_t asum = 0, op;
+	int i, acc, ai, h, err = 0;
+	
+	ir->prog = prog;
+	ir->chains = ir->n = 0;
+	ir->xstores = ir->xops = 0;
+	acc = mvir_Add(ir, IR_ACCIN, 0, 0, -1, -1);
+	for(i=0;i<128;i++)
+	{
+		op = (ucode[i] >> 14) & 3;
+		if((op & 1) && (i!=0x60) && (i!=0x70))
+			ir->chains++;
+	
+		/* Drive AI bus */
+		if(i==0)
+			ai = mvir_Add(ir, IR_ADC, i, 0, -1, -1);
+		else if(op & 2)
+			ai = (op & 1) ? mvir_Add(ir, IR_NOT, i, 0, acc, -1) : acc;
+		else
+			ai = mvir_Add(ir, IR_LOAD, i, asum, -1, -1);
+		err |= ai < 0;
+	
+		/* outputs, DRAM write, then the accumulator */
+		if((i==0x60)||(i==0x70))
+			err |= mvir_Add(ir, IR_DAC, i, (i==0x60) ? 1 : 0, ai, -1) < 0;
+		if((op&2) || (i==0))
+			err |= mvir_Add(ir, IR_STORE, i, asum, ai, -1) < 0;
+		if((i!=0x60) && (i!=0x70))
+		{
+			h = mvir_Add(ir, IR_HALF, i, 0, ai, -1);
+			acc = (op & 1) ? h : mvir_Add(ir, IR_ADD, i, 0, h, acc);
+			err |= acc < 0;
+		}
+	
+		asum = (asum + ucode[i])&0x3fff;
+	}
+	ir->sum = asum;
+	err |= mvir_Add(ir, IR_ACCOUT, 127, 0, acc, -1) < 0;
+	
+	return err;
+}
+
+/*
+ * DRAM cleared, as at power up
+ */
+void mvir_Reset(mvirst *st)
+{
+	memset(st, 0, sizeof(mvirst));
+}
+
+/*
+ * run one sample of the IR, out gets the raw L & R values the DACs read
+ */
+void mvir_Run(const mvir *ir, mvirst *st, int16_t in, int16_t *out)
+{
+	int16_t v[MVIR_MAXN];
+	const mvnode *p;
+	int i;
+	
+	for(i=0;i<ir->n;i++)
+	{
+		p = &ir->node[i];
+		if(p->dead)
+			continue;
+		switch(p->kind)
+		{
+			case IR_ADC:
+				v[i] = in;
+				break;
+	
+			case IR_ACCIN:
+				v[i] = st->acc;
+				break;
+	
+			case IR_CONST:
+				v[i] = p->k;
+				break;
+	
+			case IR_LOAD:
+				v[i] = st->mem[(st->base + p->off)&(MVIR_MEM-1)];
+				break;
+	
+			case IR_NOT:
+				v[i] = ~v[p->a];
+				break;
+	
+			case IR_HALF:
+				v[i] = (v[p->a]>>1) + (v[p->a] < 0);
+				break;
+	
+			case IR_UNITY:
+				v[i] = (v[p->a]&~1) + 2*(v[p->a] < 0);
+				break;
+	
+			case IR_ADD:
+				v[i] = v[p->a] + v[p->b];
+				break;
+	
+			case IR_STORE:
+				st->mem[(st->base + p->off)&(MVIR_MEM-1)] = v[p->a];
+				break;
+	
+			case IR_DAC:
+				out[p->off] = v[p->a];
+				break;
+	
+			case IR_ACCOUT:
+				st->acc = v[p->a];
+				break;
+		}
+	}
+	st->base = (st->base + ir->sum)&(MVIR_MEM-1);
+}
+
+/*
+ * run one sample of raw microcode as midiverb_Proc() does, on the whole
+ * ring and without the I/O scaling, for the IR to be checked against
+ */
+void mvir_Ref(const uint16_t *ucode, mvirst *st, int16_t in, int16_t *out)
+{
+	uint16_t asum = st->base, op;
+	int16_t ai;
+	int i;
+	
+	for(i=0;i<128;i++)
+	{
+		op = (ucode[i] >> 14) & 3;
+		if(i==0)
+			ai = in;
+		else if(op & 2)
+			ai = (op & 1) ? ~st->acc : st->acc;
+		else
+			ai = st->mem[asum];
+		if((i==0x60)||(i==0x70))
+			out[(i==0x60) ? 1 : 0] = ai;
+		if((op&2) || (i==0))
+			st->mem[asum] = ai;
+		if((i!=0x60) && (i!=0x70))
+			st->acc = (ai>>1) + ((op & 1) ? 0 : st->acc) + (ai < 0);
+		asum = (asum + ucode[i])&0x3fff;
+	}
+	st->base = asum;
+}
+
+/*
+ * count the live nodes using each node
+ */
+void mvir_Uses(const mvir *ir, int *uses)
+{
+	const mvnode *p;
+	int i;
+	
+	memset(uses, 0, ir->n*sizeof(int));
+	for(i=0;i<ir->n;i++)
+	{
+		p = &ir->node[i];
+		if(p->dead)
+			continue;
+		if(p->a >= 0)
+			uses[p->a]++;
+		if(p->b >= 0)
+			uses[p->b]++;
+	}
+}
+
+/*
+ * point everything using node from at node to instead, which is earlier
+ */
+static void mvir_Replace(mvir *ir, int from, int to)
+{
+	int i;
+	
+	for(i=from+1;i<ir->n;i++)
+	{
+		if(ir->node[i].a == from)
+			ir->node[i].a = to;
+		if(ir->node[i].b == from)
+			ir->node[i].b = to;
+	}
+	ir->node[from].dead = 1;
+}
+
+/*
+ * last live load or store of the same word before node n, -1 for none
+ */
+static int mvir_Prev(const mvir *ir, int n)
+{
+	const mvnode *p;
+	int i;
+	
+	for(i=n-1;i>=0;i--)
+	{
+		p = &ir->node[i];
+		if(!p->dead && ((p->kind == IR_LOAD) || (p->kind == IR_STORE)) &&
+			(p->off == ir->node[n].off))
+			return i;
+	}
+	
+	return -1;
+}
+
+/*
+ * x and y hold the same value, the same node or loads of a word that
+ * isn't stored in between
+ */
+static int mvir_Same(const mvir *ir, int x, int y)
+{
+	if(x == y)
+		return 1;
+	if(x > y)
+		return mvir_Same(ir, y, x);
+	if((ir->node[x].kind != IR_LOAD) || (ir->node[y].kind != IR_LOAD) ||
+		(ir->node[x].off != ir->node[y].off))
+		return 0;
+	while((y = mvir_Prev(ir, y)) > x)
+		if(ir->node[y].kind == IR_STORE)
+			return 0;
+	
+	return y == x;
+}
+
+/*
+ * loads of a word already stored or loaded in the sample take that value,
+ * dacs limits it to the loads the DACs read
+ */
+static int mvir_Forward(mvir *ir, int dacs)
+{
+	mvnode *p;
+	int i, j, cnt = 0;
+	
+	for(i=0;i<ir->n;i++)
+	{
+		p = &ir->node[i];
+		if(p->dead || (p->kind != IR_LOAD))
+			continue;
+		if(dacs && (p->instr != 0x60) && (p->instr != 0x70))
+			continue;
+		if((j = mvir_Prev(ir, i)) < 0)
+			continue;
+		mvir_Replace(ir, i, (ir->node[j].kind == IR_STORE) ?
+			ir->node[j].a : j);
+		cnt++;
+	}
+	
+	return cnt;
+}
+
+/*
+ * simplify outputs - DACs of a word written earlier take the value
+ */
+static int mvir_Outs(mvir *ir)
+{
+	return mvir_Forward(ir, 1);
+}
+
+/*
+ * copy propagation - every load of a word written or read earlier
+ */
+static int mvir_Copy(mvir *ir)
+{
+	return mvir_Forward(ir, 0);
+}
+
+/*
+ * constant folding, and the identities that need no constants
+ */
+static int mvir_Fold(mvir *ir)
+{
+	mvnode *p, *a, *b;
+	int i, cnt = 0;
+	int16_t k;
+	
+	for(i=0;i<ir->n;i++)
+	{
+		p = &ir->node[i];
+		if(p->dead)
+			continue;
+		a = (p->a >= 0) ? &ir->node[p->a] : NULL;
+		b = (p->b >= 0) ? &ir->node[p->b] : NULL;
+		switch(p->kind)
+		{
+			case IR_NOT:
+				if(a->kind == IR_NOT)
+				{
+					/* ~~x */
+					mvir_Replace(ir, i, a->a);
+					cnt++;
+					continue;
+				}
+				if(a->kind != IR_CONST)
+					continue;
+				k = ~a->k;
+				break;
+	
+			case IR_HALF:
+				if(a->kind != IR_CONST)
+					continue;
+				k = (a->k>>1) + (a->k < 0);
+				break;
+	
+			case IR_UNITY:
+				if(a->kind != IR_CONST)
+					continue;
+				k = (a->k&~1) + 2*(a->k < 0);
+				break;
+	
+			case IR_ADD:
+				if((a->kind == IR_CONST) && (b->kind == IR_CONST))
+				{
+					k = a->k + b->k;
+					break;
+				}
+				if(((a->kind == IR_CONST) && !a->k) ||
+					((b->kind == IR_CONST) && !b->k))
+				{
+					/* x+0 */
+					mvir_Replace(ir, i, (a->kind == IR_CONST) && !a->k ?
+						p->b : p->a);
+					cnt++;
+				}
+				continue;
+	
+			default:
+				continue;
+		}
+		p->kind = IR_CONST;
+		p->k = k;
+		p->a = p->b = -1;
+		cnt++;
+	}
+	
+	return cnt;
+}
+
+/*
+ * unity reads - acc+h(x)+h(x) is acc plus twice h(x) in one step, clear
+ * for h(x)+h(x) after the acc was dropped
+ */
+static int mvir_Unity2(mvir *ir, int clear)
+{
+	mvnode *p, *a, *b, *h;
+	int uses[MVIR_MAXN], i, cnt = 0;
+	
+	mvir_Uses(ir, uses);
+	for(i=0;i<ir->n;i++)
+	{
+		p = &ir->node[i];
+		if(p->dead || (p->kind != IR_ADD))
+			continue;
+		a = &ir->node[p->a];
+		b = &ir->node[p->b];
+		if((a->kind != IR_HALF) || (uses[p->a] != 1) || (uses[p->b] != 1))
+			continue;
+	
+		/* the half of the first read */
+		h = clear ? b : (b->kind == IR_ADD) ? &ir->node[b->a] : NULL;
+		if(!h || (h->kind != IR_HALF) || (!clear && (uses[b->a] != 1)) ||
+			!mvir_Same(ir, a->a, h->a))
+			continue;
+	
+		a->kind = IR_UNITY;
+		a->a = (a->a < h->a) ? a->a : h->a;
+		h->dead = 1;
+		if(clear)
+			mvir_Replace(ir, i, p->a);
+		else
+		{
+			p->b = b->b;
+			b->dead = 1;
+		}
+		cnt++;
+	}
+	
+	return cnt;
+}
+
+static int mvir_Unity(mvir *ir)
+{
+	return mvir_Unity2(ir, 0);
+}
+
+static int mvir_UClear(mvir *ir)
+{
+	return mvir_Unity2(ir, 1);
+}
+
+/*
+ * redundant writes - stores written over later in the sample before any
+ * load of the word
+ */
+static int mvir_DSE(mvir *ir)
+{
+	mvnode *p, *q;
+	int i, j, cnt = 0;
+	
+	for(i=ir->n-1;i>=0;i--)
+	{
+		p = &ir->node[i];
+		if(p->dead || (p->kind != IR_STORE))
+			continue;
+	
+		/* the next access to the word */
+		for(j=i+1;j<ir->n;j++)
+		{
+			q = &ir->node[j];
+			if(!q->dead && ((q->kind == IR_LOAD) || (q->kind == IR_STORE)) &&
+				(q->off == p->off))
+				break;
+		}
+		if((j < ir->n) && (q->kind == IR_STORE))
+		{
+			p->dead = 1;
+			cnt++;
+		}
+	}
+	
+	return cnt;
+}
+
+/*
+ * Smallest t >= 0 with t*sum = d modulo the ring, or 0xffff if there's
+ * none. Further solutions follow every *period samples.
+ */
+static uint16_t mvir_Steps(uint16_t sum, uint16_t d, uint16_t *period)
+{
+	uint32_t g, a, x;
+	
+	sum &= MVIR_MEM-1;
+	d &= MVIR_MEM-1;
+	if(!sum)
+	{
+		*period = 1;
+		return d ? 0xffff : 0;
+	}
+	
+	/* gcd with a power of two is sum's lowest set bit */
+	g = sum & -sum;
+	if(d & (g-1))
+		return 0xffff;
+	*period = MVIR_MEM/g;
+	
+	/* inverse of odd a, each Newton step doubles the good bits */
+	a = sum/g;
+	x = a;
+	x = (x * (2 - a*x)) & 0xffff;
+	x = (x * (2 - a*x)) & 0xffff;
+	x = (x * (2 - a*x)) & 0xffff;
+	
+	return ((d/g) * x) & (*period - 1);
+}
+
+/*
+ * samples back to the first time store k writes the word load j reads,
+ * or 0xffff if it never does
+ */
+static uint16_t mvir_Age(const mvir *ir, int j, int k)
+{
+	uint16_t t, period;
+	
+	t = mvir_Steps(ir->sum, ir->node[k].off - ir->node[j].off, &period);
+	
+	/* within a sample only earlier stores have written yet */
+	if((t == 0) && (k > j))
+		t = period;
+	
+	return t;
+}
+
+/*
+ * mark what the stores and DACs need, and the acc carried to the next
+ * sample only when that sample uses it
+ */
+static void mvir_Live(const mvir *ir, uint8_t *live, int accout)
+{
+	const mvnode *p;
+	int i;
+	
+	memset(live, 0, ir->n);
+	for(i=ir->n-1;i>=0;i--)
+	{
+		p = &ir->node[i];
+		if(p->dead)
+			continue;
+		if((p->kind == IR_STORE) || (p->kind == IR_DAC) ||
+			((p->kind == IR_ACCOUT) && accout))
+			live[i] = 1;
+		if(!live[i])
+			continue;
+		if(p->a >= 0)
+			live[p->a] = 1;
+		if(p->b >= 0)
+			live[p->b] = 1;
+	}
+}
+
+/*
+ * dead code - acc work and loads nothing uses, including the tail of the
+ * sample when the next one starts a fresh acc
+ */
+static int mvir_DCE(mvir *ir)
+{
+	uint8_t live[MVIR_MAXN];
+	int i, cnt = 0;
+	
+	mvir_Live(ir, live, 0);
+	if(live[0])
+		mvir_Live(ir, live, 1);
+	for(i=0;i<ir->n;i++)
+	{
+		if(!ir->node[i].dead && !live[i])
+		{
+			ir->node[i].dead = 1;
+			cnt++;
+		}
+	}
+	
+	return cnt;
+}
+
+/*
+ * dead delay cells - stores no load ever sees as its latest write, in
+ * this sample or any later one around the ring, then the acc work only
+ * they used. These words no longer end up as the microcode leaves them.
+ */
+static int mvir_Ring(mvir *ir)
+{
+	uint8_t seen[MVIR_MAXN];
+	uint16_t t, age;
+	int j, k, src, cnt = 0;
+	
+	memset(seen, 0, ir->n);
+	for(j=0;j<ir->n;j++)
+	{
+		if(ir->node[j].dead || (ir->node[j].kind != IR_LOAD))
+			continue;
+		
+		/* the latest store to the word, none leaves the initial 0 */
+		age = 0xffff;
+		src = -1;
+		for(k=0;k<ir->n;k++)
+		{
+			if(ir->node[k].dead || (ir->node[k].kind != IR_STORE))
+				continue;
+			t = mvir_Age(ir, j, k);
+			if((t != 0xffff) && ((t < age) || ((t == age) && (k > src))))
+			{
+				age = t;
+				src = k;
+			}
+		}
+		if(src >= 0)
+			seen[src] = 1;
+	}
+	
+	for(k=0;k<ir->n;k++)
+	{
+		if(!ir->node[k].dead && (ir->node[k].kind == IR_STORE) && !seen[k])
+		{
+			ir->node[k].dead = 1;
+			cnt++;
+		}
+	}
+	if(!cnt)
+		return 0;
+	ir->xstores += cnt;
+	ir->xops += mvir_DCE(ir);
+	
+	return cnt;
+}
+
+/* in the order they run, each undone if the check fails */
+static const mvpass mvir_passes[] =
+{
+	{"simplify outputs", MVIR_OUTS, mvir_Outs, 1},
+	{"copy propagation", MVIR_COPY, mvir_Copy, 1},
+	{"constant folding", MVIR_FOLD, mvir_Fold, 1},
+	{"unity acc reads", MVIR_UNITY, mvir_Unity, 1},
+	{"unity clear reads", MVIR_UCLEAR, mvir_UClear, 1},
+	{"redundant writes", MVIR_DSE, mvir_DSE, 1},
+	{"dead code", MVIR_DCE | MVIR_DEADEND, mvir_DCE, 1},
+	{"dead delay cells", MVIR_RING, mvir_Ring, 0},
+};
+
+/*
+ * test input, the full 16 bit range
+ */
+static int16_t mvir_Input(uint32_t *seed)
+{
+	*seed = *seed*1664525 + 1013904223;
+	return *seed >> 16;
+}
+
+/*
+ * run the microcode for the passes to be checked against, returns 1 if
+ * out of memory
+ */
+static int mvir_RefRun(mvcheck *c, const uint16_t *ucode, int samples)
+{
+	uint32_t seed = 1;
+	int i;
+	
+	c->samples = samples;
+	c->mem = 1;
+	if(!(c->out = malloc(2*samples*sizeof(int16_t))))
+		return 1;
+	mvir_Reset(&c->ref);
+	for(i=0;i<samples;i++)
+		mvir_Ref(ucode, &c->ref, mvir_Input(&seed), &c->out[2*i]);
+	
+	return 0;
+}
+
+/*
+ * run the IR the same way, returns the first sample that differs, samples
+ * if only the DRAM does, or -1 if all match
+ */
+static int mvir_Check(const mvir *ir, mvcheck *c)
+{
+	uint32_t seed = 1;
+	int16_t out[2];
+	int i;
+	
+	mvir_Reset(&c->st);
+	for(i=0;i<c->samples;i++)
+	{
+		mvir_Run(ir, &c->st, mvir_Input(&seed), out);
+		if((out[0] != c->out[2*i]) || (out[1] != c->out[2*i+1]))
+			return i;
+	}
+	if(c->mem && memcmp(c->st.mem, c->ref.mem, sizeof(c->ref.mem)))
+		return c->samples;
+	
+	return -1;
+}
+
+/*
+ * run the passes optbits enables until none finds more to do, checking
+ * each change over samples of test input unless that is 0. Returns 1 if
+ * out of memory.
+ */
+int mvir_Optimize(mvir *ir, const uint16_t *ucode, uint16_t optbits,
+	int samples, int debug)
+{
+	const int npass = sizeof(mvir_passes)/sizeof(mvpass);
+	mvcheck *c = NULL;
+	mvir *undo;
+	int i, cnt, bad, changed, mem;
+	uint16_t failed = 0;
+	
+	if(!(undo = malloc(sizeof(mvir))))
+		return 1;
+	if(samples)
+	{
+		if(!(c = malloc(sizeof(mvcheck))) || mvir_RefRun(c, ucode, samples))
+		{
+			free(c);
+			free(undo);
+			return 1;
+		}
+		if((bad = mvir_Check(ir, c)) >= 0)
+			fprintf(stderr, "Warning: program %d IR differs from microcode "
+				"at sample %d\n", ir->prog, bad);
+	}
+	
+	do
+	{
+		changed = 0;
+		for(i=0;i<npass;i++)
+		{
+			if(!(optbits & mvir_passes[i].bits) || (failed & (1<<i)))
+				continue;
+			memcpy(undo, ir, sizeof(mvir));
+			if(!(cnt = mvir_passes[i].fn(ir)))
+				continue;
+			
+			/* once a pass drops dead words only the outputs compare */
+			mem = c && c->mem;
+			if(c)
+				c->mem = mem && mvir_passes[i].mem;
+			if(c && ((bad = mvir_Check(ir, c)) >= 0))
+			{
+				/* and not tried again on this program */
+				if(bad < samples)
+					fprintf(stderr, "Warning: program %d %s changed the "
+						"output at sample %d, undone\n", ir->prog,
+						mvir_passes[i].name, bad);
+				else
+					fprintf(stderr, "Warning: program %d %s changed the "
+						"DRAM, undone\n", ir->prog, mvir_passes[i].name);
+				memcpy(ir, undo, sizeof(mvir));
+				c->mem = mem;
+				failed |= 1<<i;
+				continue;
+			}
+			dprintf("%s: %d changes%s\n", mvir_passes[i].name, cnt,
+				c ? ", verified" : "");
+			changed = 1;
+		}
+	}
+	while(changed);
+	
+	if(c)
+		free(c->out);
+	free(c);
+	free(undo);
+	
+	return 0;
+}
+
+/*
+ * live acc chains, each one a separate set of registers
+ */
+int mvir_Chains(const mvir *ir)
+{
+	uint8_t seen[256] = {0};
+	const mvnode *p;
+	int i, cnt = 0;
+	
+	for(i=0;i<ir->n;i++)
+	{
+		p = &ir->node[i];
+		if(p->dead || ((p->kind != IR_HALF) && (p->kind != IR_UNITY) &&
+			(p->kind != IR_ADD)))
+			continue;
+		cnt += !seen[p->chain];
+		seen[p->chain] = 1;
+	}
+	
+	return cnt;
+}
+
+/*
+ * cycles from a node's operands to its result, in a simple model of a
+ * scalar core: loads take 2, the rounded halves a shift and an add
+ */
+static int mvir_Lat(const mvnode *p)
+{
+	switch(p->kind)
+	{
+		case IR_ADC:
+		case IR_ACCIN:
+		case IR_CONST:
+			return 0;
+	
+		case IR_LOAD:
+		case IR_HALF:
+		case IR_UNITY:
+			return 2;
+	
+		default:
+			return 1;
+	}
+}
+
+/* cost of each addr=(addr+K)&0x3fff step */
+#define MVIR_STEP 2
+
+/*
+ * dependence edges between live nodes, from[] before to[]: operands, loads
+ * and stores of the same word unless both are loads, and the acc for the
+ * next sample written after the last read of this one's. With serial
+ * every store is ordered against every load and store, as a compiler has
+ * to when it can't tell the addresses apart. Returns the count.
+ */
+static int mvir_Edges(const mvir *ir, int serial, int16_t *from, int16_t *to)
+{
+	const mvnode *p, *q;
+	int i, j, n = 0;
+	
+	for(i=0;i<ir->n;i++)
+	{
+		p = &ir->node[i];
+		if(p->dead)
+			continue;
+		if(p->a >= 0)
+		{
+			from[n] = p->a;
+			to[n++] = i;
+		}
+		if(p->b >= 0)
+		{
+			from[n] = p->b;
+			to[n++] = i;
+		}
+	
+		/* back to the last store, and the loads since for a store */
+		if((p->kind == IR_LOAD) || (p->kind == IR_STORE))
+		{
+			for(j=i-1;j>=0;j--)
+			{
+				q = &ir->node[j];
+				if(q->dead || ((q->kind != IR_LOAD) &&
+					(q->kind != IR_STORE)) ||
+					(!serial && (q->off != p->off)))
+					continue;
+				if((q->kind == IR_STORE) || (p->kind == IR_STORE))
+				{
+					from[n] = j;
+					to[n++] = i;
+				}
+				if(q->kind == IR_STORE)
+					break;
+			}
+		}
+	
+		/* the acc variable is read as ACCIN until ACCOUT sets it */
+		if(p->kind == IR_ACCOUT)
+		{
+			for(j=1;j<i;j++)
+			{
+				q = &ir->node[j];
+				if(!q->dead && ((q->a == 0) || (q->b == 0)))
+				{
+					from[n] = j;
+					to[n++] = i;
+				}
+			}
+		}
+	}
+	
+	return n;
+}
+
+/* instructions the scheduler looks ahead, to bound the values live */
+#ifndef MVIR_WINDOW
+#define MVIR_WINDOW 16
+#endif
+
+/* edges of one program, at most */
+#define MVIR_MAXE (8*MVIR_MAXN)
+
+/*
+ * issue one instruction in order on a core issuing width per cycle, no
+ * earlier than cycle r. Returns the cycle it issues in.
+ */
+static int mvir_Slot(int *cycle, int *used, int width, int r)
+{
+	if(r > *cycle)
+	{
+		*cycle = r;
+		*used = 0;
+	}
+	if(*used == width)
+	{
+		(*cycle)++;
+		*used = 0;
+	}
+	(*used)++;
+	return *cycle;
+}
+
+/*
+ * cycles for a core issuing width instructions per cycle in order to run
+ * the cnt nodes in order, until the last result is ready. serial adds the
+ * ordering a compiler sees with a stepped address, and each step as an
+ * instruction of its own in the chain of steps.
+ */
+int mvir_Issue(const mvir *ir, const int *order, int cnt, int width,
+	int serial)
+{
+	static int16_t from[MVIR_MAXE], to[MVIR_MAXE];
+	int ready[MVIR_MAXN], i, j, e, n, t, len = 0, step = 0;
+	int cycle = 0, used = 0;
+	uint16_t cur = 0;
+	const mvnode *p;
+	
+	n = mvir_Edges(ir, serial, from, to);
+	memset(ready, 0, sizeof(ready));
+	for(i=0;i<cnt;i++)
+	{
+		j = order[i];
+		p = &ir->node[j];
+	
+		/* the address gets to each word one step after another */
+		if(serial && ((p->kind == IR_LOAD) || (p->kind == IR_STORE)) &&
+			(p->off != cur))
+		{
+			step = mvir_Slot(&cycle, &used, width, step) + MVIR_STEP;
+			cur = p->off;
+			ready[j] = ready[j] > step ? ready[j] : step;
+		}
+	
+		/* free nodes don't use an issue slot, but wait their turn */
+		if(mvir_Lat(p))
+			t = mvir_Slot(&cycle, &used, width, ready[j]);
+		else
+			t = ready[j] > cycle ? ready[j] : cycle;
+		t += mvir_Lat(p);
+		len = len > t ? len : t;
+		for(e=0;e<n;e++)
+			if((from[e] == j) && (ready[to[e]] < t))
+				ready[to[e]] = t;
+	}
+	
+	return len;
+}
+
+/*
+ * list schedule the live nodes for a core issuing width per cycle, the
+ * ready node with the longest path to the end first, so the chains
+ * interleave. Looking no more than MVIR_WINDOW instructions ahead keeps
+ * the values in flight to what fits in registers. Returns the count put
+ * in order.
+ */
+int mvir_Schedule(const mvir *ir, int width, int *order)
+{
+	static int16_t from[MVIR_MAXE], to[MVIR_MAXE];
+	int npred[MVIR_MAXN], ready[MVIR_MAXN], height[MVIR_MAXN];
+	int i, e, n, best, cnt = 0, live = 0, cycle, issued, first;
+	uint8_t placed[MVIR_MAXN];
+	
+	n = mvir_Edges(ir, 0, from, to);
+	memset(npred, 0, sizeof(npred));
+	memset(ready, 0, sizeof(ready));
+	memset(placed, 0, sizeof(placed));
+	for(i=ir->n-1;i>=0;i--)
+	{
+		height[i] = mvir_Lat(&ir->node[i]);
+		live += !ir->node[i].dead;
+	}
+	
+	/* edges only go forward, so one backward sweep finds the heights */
+	for(e=n-1;e>=0;e--)
+		npred[to[e]]++;
+	for(i=ir->n-1;i>=0;i--)
+		for(e=0;e<n;e++)
+			if((from[e] == i) && (height[i] <
+				mvir_Lat(&ir->node[i]) + height[to[e]]))
+				height[i] = mvir_Lat(&ir->node[i]) + height[to[e]];
+	
+	for(cycle=0;cnt<live;cycle++)
+	{
+		for(issued=0;issued<width;)
+		{
+			/* within reach of the oldest instruction still to go */
+			for(first=0;placed[first] || ir->node[first].dead;first++);
+			first = ir->node[first].instr;
+			for(best=-1,i=0;i<ir->n;i++)
+				if(!ir->node[i].dead && !placed[i] && !npred[i] &&
+					(ready[i] <= cycle) &&
+					(ir->node[i].instr < first + MVIR_WINDOW) &&
+					((best < 0) || (height[i] > height[best])))
+					best = i;
+			if(best < 0)
+				break;
+			placed[best] = 1;
+			order[cnt++] = best;
+			for(e=0;e<n;e++)
+			{
+				if(from[e] != best)
+					continue;
+				npred[to[e]]--;
+				i = cycle + mvir_Lat(&ir->node[best]);
+				ready[to[e]] = ready[to[e]] > i ? ready[to[e]] : i;
+			}
+	
+			/* free nodes don't use an issue slot */
+			issued += mvir_Lat(&ir->node[best]) > 0;
+		}
+	}
+	
+	return cnt;
+}
@@ -0,0 +1,91 @@
+/*
+ * mv_ir.h - dataflow IR and verified optimization passes for mv_gencode
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_ir__
+#define __mv_ir__
+
+#include <stdint.h>
+
+/* nodes in one sample of one program */
+#define MVIR_MAXN 1024
+
+/* DRAM words, the ring the generated code addresses */
+#define MVIR_MEM 16384
+
+/* node kinds */
+enum
+{
+	IR_ADC,							/* input sample */
+	IR_ACCIN,						/* acc left by the last sample */
+	IR_CONST,						/* k */
+	IR_LOAD,						/* mem[base+off] */
+	IR_NOT,							/* ~a */
+	IR_HALF,						/* (a>>1) + (a<0) */
+	IR_UNITY,						/* twice IR_HALF, (a&~1) + 2*(a<0) */
+	IR_ADD,							/* a + b */
+	IR_STORE,						/* mem[base+off] = a */
+	IR_DAC,							/* output channel off = a, 0 L 1 R */
+	IR_ACCOUT,						/* acc for the next sample = a */
+};
+
+typedef struct
+{
+	uint8_t kind;
+	uint8_t dead;					/* removed by a pass */
+	uint8_t instr;					/* microcode instruction it came from */
+	uint8_t chain;					/* acc chain, a new one at each LDHALF */
+	uint16_t off;					/* DRAM offset from the sample base */
+	int16_t k;						/* IR_CONST value */
+	int16_t a, b;					/* operand nodes, always earlier ones */
+} mvnode;
+
+/*
+ * One sample of a program as a list of nodes in microcode order. Every
+ * value is int16_t, loads and stores keep their order to each other and
+ * two offsets only alias when they are equal.
+ */
+typedef struct
+{
+	int prog;
+	uint16_t sum;					/* base increment per sample */
+	int chains;						/* acc chains */
+	int xstores, xops;				/* removed as dead across samples */
+	int n;							/* nodes */
+	mvnode node[MVIR_MAXN];
+} mvir;
+
+/* state of a running program */
+typedef struct
+{
+	uint16_t base;
+	int16_t acc;
+	int16_t mem[MVIR_MEM];
+} mvirst;
+
+/* optimization bits, as given to mv_gencode -O */
+#define MVIR_DCE 0x0001				/* dead acc work, trailing NOPs */
+#define MVIR_OUTS 0x0002			/* DACs take the word written earlier */
+#define MVIR_DEADEND 0x0004			/* dead acc work, dead ends */
+#define MVIR_FAST 0x0008			/* inexact arithmetic, emitter only */
+#define MVIR_UNITY 0x0010			/* same word read twice adds once */
+#define MVIR_UCLEAR 0x0020			/* same word read twice loads once */
+#define MVIR_DSE 0x0040				/* stores overwritten in the sample */
+#define MVIR_FOLD 0x0080			/* constant folding */
+#define MVIR_COPY 0x0100			/* copy propagation of loads */
+#define MVIR_RING 0x0200			/* stores no later sample reads */
+
+int mvir_Build(mvir *ir, int prog, const uint16_t *ucode);
+void mvir_Reset(mvirst *st);
+void mvir_Run(const mvir *ir, mvirst *st, int16_t in, int16_t *out);
+void mvir_Ref(const uint16_t *ucode, mvirst *st, int16_t in, int16_t *out);
+void mvir_Uses(const mvir *ir, int *uses);
+int mvir_Chains(const mvir *ir);
+int mvir_Issue(const mvir *ir, const int *order, int cnt, int width,
+	int serial);
+int mvir_Schedule(const mvir *ir, int width, int *order);
+int mvir_Optimize(mvir *ir, const uint16_t *ucode, uint16_t optbits,
+	int samples, int debug);
+
+#endif
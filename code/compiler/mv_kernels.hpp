@@ -0,0 +1,255 @@
+/*
+ * mv_kernels.hpp - compile-time specialized Midiverb program kernels
+ * 10-17-26 E. Brombaugh
+ *
+ * Header-only C++17 alternative to running mv_gencode. The microcode
+ * table from mv_ucode.h is made constexpr, each program is analyzed at
+ * compile time and template<int Prog> kernels are fully unrolled by the
+ * compiler. The same rewrites as mv_gencode are applied, in forms that
+ * stay bit-exact with the emulator:
+ *  - NOP stripping: acc ops whose result is never used are dropped
+ *  - output relocation: DAC reads of a word written earlier in the
+ *    sample take the written value directly
+ *  - unity reads: the same word read twice in a row becomes one load
+ *
+ * Usage: mvk::kernels[prog](state, in, out, frames) with interleaved
+ * stereo in/out, as midiverb_ProcBlock().
+ */
+
+#ifndef __mv_kernels__
+#define __mv_kernels__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace mvk
+{
+
+/* the microcode, as a compile-time constant */
+namespace rom
+{
+using std::uint16_t;
+inline constexpr
+#include "mv_ucode.h"
+}
+
+/* per-instance state */
+struct state
+{
+	int16_t acc;					/* accumulator */
+	uint16_t asum;					/* Address Gen */
+	int16_t mem[16384];				/* DRAM data store */
+};
+
+/* instruction flags */
+enum : uint8_t
+{
+	NOACC = 1,						/* acc result never used */
+	NOP = 2,						/* folded into the next instruction */
+	UNITY = 4,						/* second half of a unity read */
+};
+
+/* result of the compile-time analysis */
+struct prog_info
+{
+	uint8_t op[128];				/* operation */
+	uint16_t off[128];				/* offset from sample base */
+	uint8_t flags[128];				/* rewrites applied */
+	uint8_t rsrc, lsrc;				/* instr feeding a relocated DAC */
+	uint16_t sum;					/* base increment per sample */
+};
+
+/* no relocation */
+inline constexpr uint8_t NONE = 0xff;
+
+/*
+ * analyze one program
+ */
+constexpr prog_info analyze(int prog)
+{
+	prog_info p{};
+	uint16_t asum = 0;
+	bool live = false, live0 = false;
+	
+	for(int i=0;i<128;i++)
+	{
+		uint16_t w = rom::mv_ucode[prog*128 + i];
+		p.op[i] = (w >> 14) & 3;
+		p.off[i] = asum;
+		asum = (asum + w) & 0x3fff;
+	}
+	p.sum = asum;
+	
+	/* NOP stripping - acc liveness wrapping into the next sample */
+	while(true)
+	{
+		live = live0;
+		for(int i=127;i>=0;i--)
+		{
+			if((i!=0x60) && (i!=0x70))
+			{
+				p.flags[i] = live ? 0 : NOACC;
+				live = live && !(p.op[i] & 1);
+			}
+			if(i && (p.op[i] & 2))
+				live = true;
+		}
+		if(live == live0)
+			break;
+		live0 = live;
+	}
+	
+	/* unity reads - same word read twice adds (m & ~1) + 2*sgn */
+	for(int i=2;i<128;i++)
+	{
+		int j = i-1;
+		if((i==0x60) || (i==0x70) || (j==0x60) || (j==0x70))
+			continue;
+		if((p.op[i] != 0) || (p.op[j] & 2) || (p.off[i] != p.off[j]))
+			continue;
+		if(p.flags[i] || p.flags[j])
+			continue;
+		p.flags[j] |= NOP;
+		p.flags[i] |= UNITY;
+	}
+	
+	/* output relocation - last write to a DAC's word in this sample */
+	p.rsrc = p.lsrc = NONE;
+	for(int d : {0x60, 0x70})
+	{
+		uint8_t src = NONE;
+		
+		if(p.op[d] & 2)
+			continue;
+		for(int i=0;i<d;i++)
+			if(((i==0) || (p.op[i] & 2)) && (p.off[i] == p.off[d]))
+				src = i;
+		if(d == 0x60)
+			p.rsrc = src;
+		else
+			p.lsrc = src;
+	}
+	
+	return p;
+}
+
+template<int Prog>
+inline constexpr prog_info info = analyze(Prog);
+
+/*
+ * one instruction, fully resolved at compile time
+ */
+template<int Prog, int I>
+inline void step(int16_t *mem, uint16_t base, int16_t &acc, int16_t &dr,
+	int16_t &dl, const int16_t *in, int16_t *out)
+{
+	constexpr const prog_info &p = info<Prog>;
+	constexpr uint8_t op = p.op[I], fl = p.flags[I];
+	constexpr bool dac = (I==0x60) || (I==0x70);
+	constexpr bool wr = (I==0) || (op & 2);
+	constexpr bool reloc = (I==0x60) ? (p.rsrc != NONE) :
+		(I==0x70) ? (p.lsrc != NONE) : false;
+	
+	/* reads feeding a dead acc do nothing at all */
+	if constexpr((fl & NOP) || (I && !wr && !dac && (fl & NOACC)))
+		return;
+	else
+	{
+		int16_t &m = mem[(base + p.off[I]) & 0x3fff];
+		int16_t ai, t;
+		
+		/* Drive AI bus */
+		if constexpr(I==0)
+			ai = ((in[0]>>4) + (in[1]>>4)) & 0xFFFE;
+		else if constexpr(op & 2)
+			ai = (op & 1) ? ~acc : acc;
+		else if constexpr(reloc)
+			ai = (I==0x60) ? dr : dl;
+		else
+			ai = m;
+		
+		/* DRAM write */
+		if constexpr(wr)
+			m = ai;
+		
+		/* keep values the DACs will read back */
+		if constexpr(p.rsrc == I)
+			dr = ai;
+		if constexpr(p.lsrc == I)
+			dl = ai;
+		
+		if constexpr(dac)
+		{
+			/* saturate, scale and route to proper channel */
+			if(ai > 4095)
+				ai = 4095;
+			else if(ai < -4096)
+				ai = -4096;
+			out[(I==0x60) ? 1 : 0] = ai << 3;
+		}
+		else if constexpr(!(fl & NOACC))
+		{
+			/* update accumulator */
+			constexpr bool keep = (fl & UNITY) ? !(p.op[I-1] & 1) : !(op & 1);
+			
+			if constexpr(fl & UNITY)
+				t = (ai & ~1) + 2*((uint16_t)ai >> 15);
+			else
+				t = (ai >> 1) + ((uint16_t)ai >> 15);
+			acc = keep ? acc + t : t;
+		}
+	}
+}
+
+/*
+ * one sample, all 128 instructions unrolled
+ */
+template<int Prog, std::size_t... I>
+inline void sample(int16_t *mem, uint16_t base, int16_t &acc,
+	const int16_t *in, int16_t *out, std::index_sequence<I...>)
+{
+	int16_t dr = 0, dl = 0;
+	
+	(step<Prog, I>(mem, base, acc, dr, dl, in, out), ...);
+}
+
+/*
+ * block processor for one program
+ */
+template<int Prog>
+void block(state &s, const int16_t *in, int16_t *out, std::size_t frames)
+{
+	int16_t *mem = s.mem, acc = s.acc;
+	uint16_t base = s.asum;
+	
+	while(frames--)
+	{
+		sample<Prog>(mem, base, acc, in, out,
+			std::make_index_sequence<128>{});
+		base = (base + info<Prog>.sum) & 0x3fff;
+		in += 2;
+		out += 2;
+	}
+	
+	s.acc = acc;
+	s.asum = base;
+}
+
+/* dispatch table of all programs */
+using block_fn = void (*)(state &, const int16_t *, int16_t *, std::size_t);
+
+template<std::size_t... P>
+constexpr std::array<block_fn, sizeof...(P)> make_table(
+	std::index_sequence<P...>)
+{
+	return {{ &block<P>... }};
+}
+
+inline constexpr std::array<block_fn, 63> kernels =
+	make_table(std::make_index_sequence<63>{});
+
+}
+
+#endif
@@ -4,19 +4,91 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 #include "wav_ops.h"
+#include "../emulator/mv_resamp.h"
+
+/* frames per call to the programs */
+#define BLOCKSZ 256
 
 /* the array of individual programs */
+#ifdef MV_REENTRANT
+#include "mv_progs_r.h"
+static mv_state state;
+#elif defined(MV_SIMD)
+#include "mv_progs_simd.h"
+static mv_state state;
+#else
 extern void (*mv_progs[63])(int16_t, int16_t *, int16_t *);
+#endif
+
+/*
+ * run a block of stereo frames thru a program
+ */
+static void sim_block(int prog, const int16_t *in, int16_t *out,
+	size_t frames)
+{
+	int16_t mono[BLOCKSZ];
+	size_t i;
+#ifdef MV_SIMD
+	int16_t lin[BLOCKSZ*MV_VLEN], lout[2*BLOCKSZ*MV_VLEN];
+	int l;
+#endif
+	
+	/* below ~24kHz the resampler hands over more than BLOCKSZ frames */
+	for(;frames>BLOCKSZ;frames-=BLOCKSZ,in+=2*BLOCKSZ,out+=2*BLOCKSZ)
+		sim_block(prog, in, out, BLOCKSZ);
+	
+	/* scale for input */
+	for(i=0;i<frames;i++)
+		mono[i] = ((in[2*i]>>1)+(in[2*i+1]>>1))>>2;
+	
+	/* process thru midiverb emulator */
+#ifdef MV_REENTRANT
+	(*mv_progs[prog])(&state, mono, out, frames);
+#elif defined(MV_SIMD)
+	/* the same stream in every lane, lane 0 comes out */
+	for(i=0;i<frames;i++)
+		for(l=0;l<MV_VLEN;l++)
+			lin[MV_VLEN*i + l] = mono[i];
+	(*mv_progs[prog])(&state, lin, lout, frames);
+	for(i=0;i<frames;i++)
+	{
+		out[2*i] = lout[2*MV_VLEN*i];
+		out[2*i+1] = lout[2*MV_VLEN*i+1];
+	}
+#else
+	for(i=0;i<frames;i++)
+		(*mv_progs[prog])(mono[i], &out[2*i], &out[2*i+1]);
+#endif
+	
+	/* unscale and saturate */
+	for(i=0;i<2*frames;i++)
+	{
+		int32_t sat = out[i]<<2;
+		sat = sat > 32767 ? 32767 : sat;
+		sat = sat < -32768 ? -32768 : sat;
+		out[i] = sat;
+	}
+}
 
 int main(int argc, char **argv)
 {
-	int prog = 21;
+	int prog = 21, native = 0;
 	char *iname = "input.wav", *oname = "output.wav";
-	FILE *ifile, *ofile;
-	int16_t in[2], out[2];
+	int16_t zero[2*BLOCKSZ] = {0}, *in, *out, *nin, *nout, *hout;
+	wav_map imap, omap;
 	wav_hdr wh;
-	int32_t samples, scnt, chl;
+	int32_t samples, scnt, written, frames;
+	size_t n, m;
+	mvrs down, up;
+	
+	/* -n runs the program at the hardware sample rate */
+	if(getopt(argc, argv, "n") == 'n')
+		native = 1;
+	argc -= optind - 1;
+	argv += optind - 1;
 	
 	/* override defaults */
 	if(argc > 1)
@@ -28,86 +100,89 @@ int main(int argc, char **argv)
 	if(argc > 3)
 		oname = argv[3];
 		
-	/* open input wav file */
-	if(!(ifile = fopen(iname, "rb")))
-	{
-		fprintf(stderr, "Couldn't open input file %s for read\n", iname);
-		exit(1);
-	}
-	
-	/* get WAV header & check if it's valid */
-	if(fread(&wh, sizeof(wav_hdr), 1, ifile) != 1)
+	/* map input wav file */
+	if(wav_map_read(&imap, iname))
 	{
-		fprintf(stderr, "Unexepected EOF in input file.\n");
-		fclose(ifile);
+		fprintf(stderr, "Couldn't map input file %s for read\n", iname);
 		exit(1);
 	}
+	wh = imap.hdr;
 	
 	/* check WAV header is valid */
 	if(wav_check_hdr(&wh, 2, 16))
 	{
 		fprintf(stderr, "Incorrect input file format.\n");
-		fclose(ifile);
+		wav_unmap(&imap);
 		exit(1);
 	}
 	samples = wh.data_sz / wh.fmt_bytesmpl;
 	
-	/* open output file */
-	if(!(ofile = fopen(oname, "wb")))
+	/* host rate -> hardware rate -> host rate */
+	if(native)
 	{
-		fprintf(stderr, "Couldn't open output file %s for write\n", oname);
-		fclose(ifile);
-		exit(1);
+		if(mvrs_Init(&down, 2*wh.fmt_smplrate, MV_RATE2) ||
+			mvrs_Init(&up, MV_RATE2, 2*wh.fmt_smplrate))
+		{
+			fprintf(stderr, "Out of memory\n");
+			wav_unmap(&imap);
+			exit(1);
+		}
+		n = mvrs_MaxOut(&down, BLOCKSZ);
+		nin = malloc(2*n*sizeof(int16_t));
+		/* a program may never write one of its outputs */
+		nout = calloc(2*n, sizeof(int16_t));
+		hout = malloc(2*mvrs_MaxOut(&up, n)*sizeof(int16_t));
+		if(!nin || !nout || !hout)
+		{
+			fprintf(stderr, "Out of memory\n");
+			wav_unmap(&imap);
+			exit(1);
+		}
 	}
 	
-	/* tack on the wav header */
-	if(fwrite(&wh, sizeof(wav_hdr), 1, ofile) != 1)
+	/* map output file with the wav header on it */
+	if(wav_map_write(&omap, oname, &wh))
 	{
-		fprintf(stderr, "Write WAV header to output file failed.\n");
-		fclose(ofile);
-		fclose(ifile);
+		fprintf(stderr, "Couldn't map output file %s for write\n", oname);
+		wav_unmap(&imap);
 		exit(1);
 	}
 		
-	/* process the audio data one stereo sample at a time */
-	for(scnt=0;scnt<samples;scnt++)
+	/* process the audio data one block at a time */
+	for(scnt=0,written=0;written<samples;scnt+=frames)
 	{
-		/* get a stereo sample */
-		if(fread(in, sizeof(int16_t), 2, ifile) != 2)
-		{
-			fprintf(stderr, "Unexepected EOF in input file.\n");
-			fclose(ofile);
-			fclose(ifile);
-			exit(1);
-		}
-		
-		/* scale for input */
-		int16_t mono = ((in[0]>>1)+(in[1]>>1))>>2;
-		
-		/* process thru midiverb emulator */
-		(*mv_progs[prog])(mono, &out[0], &out[1]);
+		/* stereo samples in place, silence flushes the resampler */
+		frames = samples-scnt < BLOCKSZ ? samples-scnt : BLOCKSZ;
+		in = frames ? (int16_t *)imap.data + 2*scnt : zero;
+		out = (int16_t *)omap.data + 2*written;
 		
-		/* unscale and saturate */
-		for(chl=0;chl<2;chl++)
+		if(native)
 		{
-			int32_t sat = out[chl]<<2;
-			sat = sat > 32767 ? 32767 : sat;
-			sat = sat < -32768 ? -32768 : sat;
-			out[chl] = sat;
+			n = mvrs_Proc(&down, in, frames ? frames : BLOCKSZ, nin);
+			sim_block(prog, nin, nout, n);
+			m = mvrs_Proc(&up, nout, n, hout);
+			if(m > samples - written)
+				m = samples - written;
+			memcpy(out, hout, 2*m*sizeof(int16_t));
 		}
-		
-		/* put a stereo sample */
-		if(fwrite(out, sizeof(int16_t), 2, ofile) != 2)
+		else
 		{
-			fprintf(stderr, "Error in output file.\n");
-			fclose(ofile);
-			fclose(ifile);
-			exit(1);
+			sim_block(prog, in, out, frames);
+			m = frames;
 		}
+		written += m;
 	}
 		
 	/* done */
-	fclose(ofile);
-	fclose(ifile);
+	if(native)
+	{
+		free(hout);
+		free(nout);
+		free(nin);
+		mvrs_Free(&up);
+		mvrs_Free(&down);
+	}
+	wav_unmap(&omap);
+	wav_unmap(&imap);
 	exit(0);
 }
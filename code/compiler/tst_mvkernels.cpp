@@ -0,0 +1,135 @@
+/* tst_mvkernels.cpp - test compile-time kernels against the emulator */
+/* 10-17-26 E. Brombaugh */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include "mv_kernels.hpp"
+extern "C" {
+#include "wav_ops.h"
+#include "../emulator/midiverb.h"
+}
+
+/* nanoseconds since an arbitrary point */
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	int prog = 21;
+	const char *iname = "input.wav", *oname = "output.wav";
+	FILE *ifile, *ofile;
+	int16_t *in, *ref, *out;
+	wav_hdr wh;
+	int32_t samples, scnt, errs = 0;
+	static mvblk mv;
+	static mvk::state st;
+	double t0, t1, t2;
+	
+	/* override defaults */
+	if(argc > 1)
+		prog = atoi(argv[1]);
+	
+	if(argc > 2)
+		iname = argv[2];
+	
+	if(argc > 3)
+		oname = argv[3];
+	
+	if((prog < 0) || (prog > 62))
+	{
+		fprintf(stderr, "Program %d out of range\n", prog);
+		exit(1);
+	}
+		
+	/* open input wav file */
+	if(!(ifile = fopen(iname, "rb")))
+	{
+		fprintf(stderr, "Couldn't open input file %s for read\n", iname);
+		exit(1);
+	}
+	
+	/* get WAV header & check if it's valid */
+	if(fread(&wh, sizeof(wav_hdr), 1, ifile) != 1)
+	{
+		fprintf(stderr, "Unexepected EOF in input file.\n");
+		fclose(ifile);
+		exit(1);
+	}
+	
+	/* check WAV header is valid */
+	if(wav_check_hdr(&wh, 2, 16))
+	{
+		fprintf(stderr, "Incorrect input file format.\n");
+		fclose(ifile);
+		exit(1);
+	}
+	samples = wh.data_sz / wh.fmt_bytesmpl;
+	
+	/* get all the audio at once */
+	in = (int16_t *)malloc(samples * 2 * sizeof(int16_t));
+	ref = (int16_t *)malloc(samples * 2 * sizeof(int16_t));
+	out = (int16_t *)malloc(samples * 2 * sizeof(int16_t));
+	if(!in || !ref || !out)
+	{
+		fprintf(stderr, "Couldn't allocate buffers.\n");
+		fclose(ifile);
+		exit(1);
+	}
+	if(fread(in, sizeof(int16_t), samples * 2, ifile) != (size_t)samples * 2)
+	{
+		fprintf(stderr, "Unexepected EOF in input file.\n");
+		fclose(ifile);
+		exit(1);
+	}
+	fclose(ifile);
+	
+	/* process thru midiverb emulator */
+	midiverb_Init(&mv);
+	midiverb_SetProg(&mv, prog);
+	t0 = now_ns();
+	midiverb_ProcBlock(&mv, in, ref, samples);
+	
+	/* process thru the specialized kernel */
+	t1 = now_ns();
+	mvk::kernels[prog](st, in, out, samples);
+	t2 = now_ns();
+	
+	/* test against reference */
+	for(scnt=0;scnt<samples*2;scnt++)
+		if(ref[scnt] != out[scnt])
+			errs++;
+	
+	/* open output file */
+	if(!(ofile = fopen(oname, "wb")))
+	{
+		fprintf(stderr, "Couldn't open output file %s for write\n", oname);
+		exit(1);
+	}
+	
+	/* write header and audio */
+	if((fwrite(&wh, sizeof(wav_hdr), 1, ofile) != 1) ||
+		(fwrite(out, sizeof(int16_t), samples * 2, ofile) !=
+			(size_t)samples * 2))
+	{
+		fprintf(stderr, "Error in output file.\n");
+		fclose(ofile);
+		exit(1);
+	}
+	
+	printf("Samples = %d, Errors = %d\n", samples, errs);
+	printf("emulator %.1f ns/sample, kernel %.1f ns/sample\n",
+		(t1 - t0) / samples, (t2 - t1) / samples);
+		
+	/* done */
+	free(out);
+	free(ref);
+	free(in);
+	fclose(ofile);
+	exit(errs ? 1 : 0);
+}
@@ -7,6 +7,7 @@
 #define __wav_ops__
 
 #include <stdint.h>
+#include <stddef.h>
 
 typedef struct
 {
@@ -25,8 +26,23 @@ typedef struct
 	uint32_t data_sz;
 } wav_hdr;
 
+/* a .WAV file mapped into memory, samples used in place */
+typedef struct
+{
+	wav_hdr hdr;					/* canonical header for the data */
+	void *data;						/* samples within the mapping */
+	void *base;
+	size_t len;
+	int fd;
+} wav_map;
+
 void wav_write_hdr(wav_hdr *wh, uint32_t smpls, uint8_t chls, uint8_t bits,
 				   uint32_t rate);
 uint8_t wav_check_hdr(wav_hdr *wh, uint8_t chls, uint8_t bits);
+uint8_t wav_parse(const uint8_t *buf, size_t len, wav_hdr *wh, size_t *offs);
+int wav_map_read(wav_map *wm, const char *name);
+int wav_map_write(wav_map *wm, const char *name, const wav_hdr *wh);
+int wav_map_sync(wav_map *wm);
+void wav_unmap(wav_map *wm);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+/* bench_midiverb.c - time the midiverb emulator engines on all programs */
+/* 10-17-26 E. Brombaugh */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "midiverb.h"
+#include "mv_lanes.h"
+#include "mv_tvec.h"
+#include "mv_jit.h"
+
+/* frames per call to the emulator */
+#define BLOCKSZ 256
+
+/* compiled program for the jit column */
+static mvjit jit;
+static double jit_ns;
+
+static void jit_proc(mvblk *mv, const int16_t *in, int16_t *out,
+	size_t frames)
+{
+	mvjit_ProcBlock(&jit, mv, in, out, frames);
+}
+
+/* instance with the smallest DRAM ring for the ring column */
+static mvblk *ring;
+
+/* engines to compare */
+static const struct
+{
+	uint8_t engine;
+	void (*proc)(mvblk *, const int16_t *, int16_t *, size_t);
+	char *name;
+	uint8_t ring;					/* run on the smallest ring instead */
+} engines[] =
+{
+	{MV_ENG_SWITCH, midiverb_ProcBlock, "switch", 0},
+	{MV_ENG_DECODED, midiverb_ProcBlock, "decoded", 0},
+	{MV_ENG_THREADED, midiverb_ProcBlock, "threaded", 0},
+	{MV_ENG_DECODED, mvtvec_ProcBlock, "tvec", 0},
+	{MV_ENG_DECODED, jit_proc, "jit", 0},
+	{MV_ENG_DECODED, midiverb_ProcBlock, "ring", 1},
+};
+#define NUM_ENG (sizeof(engines)/sizeof(engines[0]))
+
+/*
+ * current time in ns
+ */
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* frame offset between lane inputs */
+#define LANE_SKEW 997
+
+/*
+ * run one program on one engine, return ns per sample
+ */
+static double run(mvblk *mv, uint8_t prog, uint8_t e,
+	const int16_t *in, int16_t *out, int32_t samples)
+{
+	int32_t scnt, frames;
+	double t;
+	
+	/* fresh instance sized for the program */
+	if(engines[e].ring)
+	{
+		free(ring);
+		if(!(ring = midiverb_Alloc(prog)))
+		{
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		mv = ring;
+	}
+	else
+	{
+		midiverb_Init(mv);
+		midiverb_SetProg(mv, prog);
+	}
+	midiverb_SetEngine(mv, engines[e].engine);
+	
+	/* time program switches for the jit */
+	if(engines[e].proc == jit_proc)
+	{
+		t = now_ns();
+		mvjit_Compile(&jit, midiverb_Ucode(prog), MV_JIT_OPT);
+		jit_ns += now_ns() - t;
+	}
+	
+	t = now_ns();
+	for(scnt=0;scnt<samples;scnt+=frames)
+	{
+		frames = samples-scnt < BLOCKSZ ? samples-scnt : BLOCKSZ;
+		engines[e].proc(mv, &in[2*scnt], &out[2*scnt], frames);
+	}
+	return (now_ns() - t) / samples;
+}
+
+/*
+ * run one program on a group of lanes, return ns per stream sample
+ */
+static double run_lanes(mvlanes *ml, uint8_t prog, const int16_t *in,
+	int16_t *out, int32_t samples)
+{
+	int32_t scnt, frames;
+	double t;
+	
+	mvlanes_Init(ml);
+	mvlanes_SetProg(ml, prog);
+	
+	t = now_ns();
+	for(scnt=0;scnt<samples;scnt+=frames)
+	{
+		frames = samples-scnt < BLOCKSZ ? samples-scnt : BLOCKSZ;
+		mvlanes_ProcBlock(ml, &in[2*MV_LANES*scnt], &out[2*MV_LANES*scnt],
+			frames);
+	}
+	return (now_ns() - t) / samples / MV_LANES;
+}
+
+/*
+ * run the input then silence four address periods long, a block at a time
+ * and sample by sample. Returns the percentage of the silence skipped as
+ * idle, or -1 if the outputs differ.
+ */
+static double run_idle(mvblk *mv, mvblk *pv, uint8_t prog, const int16_t *in,
+	int32_t samples)
+{
+	static int16_t zero[2*BLOCKSZ], out[2*BLOCKSZ];
+	int16_t pout[2];
+	const int16_t *src;
+	int32_t scnt, frames, tail, j;
+	
+	midiverb_Init(mv);
+	midiverb_SetProg(mv, prog);
+	midiverb_Init(pv);
+	midiverb_SetProg(pv, prog);
+	tail = 4*midiverb_Period(mv);
+	
+	for(scnt=0;scnt<samples+tail;scnt+=frames)
+	{
+		frames = scnt < samples ? samples-scnt : samples+tail-scnt;
+		frames = frames < BLOCKSZ ? frames : BLOCKSZ;
+		src = scnt < samples ? &in[2*scnt] : zero;
+		midiverb_ProcBlock(mv, src, out, frames);
+		for(j=0;j<frames;j++)
+		{
+			midiverb_Proc(pv, &src[2*j], pout);
+			if((pout[0] != out[2*j]) || (pout[1] != out[2*j+1]))
+				return -1;
+		}
+	}
+	return 100.0 * mv->nidle / tail;
+}
+
+/*
+ * check one lane of a group against the single instance engine
+ */
+static int check_lane(mvblk *mv, uint8_t prog, const int16_t *lin,
+	const int16_t *lout, int16_t *in, int16_t *out, int32_t samples,
+	uint8_t lane)
+{
+	int32_t i;
+	
+	for(i=0;i<samples;i++)
+	{
+		in[2*i] = lin[2*(MV_LANES*i + lane)];
+		in[2*i+1] = lin[2*(MV_LANES*i + lane)+1];
+	}
+	run(mv, prog, 1, in, out, samples);
+	for(i=0;i<samples;i++)
+		if((out[2*i] != lout[2*(MV_LANES*i + lane)]) ||
+			(out[2*i+1] != lout[2*(MV_LANES*i + lane)+1]))
+			return 1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int32_t samples = 48000, i;
+	int16_t *in, *ref, *out, *lin, *lout, *tin;
+	uint8_t prog, e, l, nidle = 0;
+	double ns, tot[NUM_ENG], ltot = 0;
+	mvblk *mv, *pv;
+	mvlanes *ml;
+	
+	/* override defaults */
+	if(argc > 1)
+		samples = atoi(argv[1]);
+	
+	/* buffers */
+	mv = malloc(sizeof(mvblk));
+	pv = malloc(sizeof(mvblk));
+	in = malloc(2*samples*sizeof(int16_t));
+	ref = malloc(2*samples*sizeof(int16_t));
+	out = malloc(2*samples*sizeof(int16_t));
+	tin = malloc(2*samples*sizeof(int16_t));
+	ml = malloc(sizeof(mvlanes));
+	lin = malloc(2*MV_LANES*samples*sizeof(int16_t));
+	lout = malloc(2*MV_LANES*samples*sizeof(int16_t));
+	if(!mv || !pv || !in || !ref || !out || !tin || !ml || !lin || !lout)
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if(mvjit_Init(&jit))
+		fprintf(stderr, "No executable memory, jit column will fail\n");
+	
+	/* noise bursts with gaps so programs see both signal & decay */
+	srand(1);
+	for(i=0;i<2*samples;i++)
+		in[i] = ((i/4096)&1) ? 0 : (rand() & 0xffff) - 32768;
+	
+	/* each lane sees the same signal skewed in time */
+	for(i=0;i<samples;i++)
+		for(l=0;l<MV_LANES;l++)
+		{
+			lin[2*(MV_LANES*i + l)] = in[2*((i + l*LANE_SKEW)%samples)];
+			lin[2*(MV_LANES*i + l)+1] = in[2*((i + l*LANE_SKEW)%samples)+1];
+		}
+	
+	/* table header */
+	fprintf(stdout, "prog");
+	for(e=0;e<NUM_ENG;e++)
+		fprintf(stdout, " %10s", engines[e].name);
+	fprintf(stdout, "   lanes*%2d  maxblk  ring dead skip  idle%%", MV_LANES);
+	fprintf(stdout, "   (ns/sample, * = mismatch vs %s)\n", engines[0].name);
+	memset(tot, 0, sizeof(tot));
+	
+	for(prog=0;prog<63;prog++)
+	{
+		fprintf(stdout, "%4d", prog);
+		for(e=0;e<NUM_ENG;e++)
+		{
+			ns = run(mv, prog, e, in, e ? out : ref, samples);
+			tot[e] += ns;
+			fprintf(stdout, " %9.1f%c", ns,
+				(e && memcmp(ref, out, 2*samples*sizeof(int16_t))) ? '*' : ' ');
+		}
+		
+		/* lanes report time per stream & check first and last lanes */
+		ns = run_lanes(ml, prog, lin, lout, samples);
+		ltot += ns;
+		fprintf(stdout, " %9.1f%c", ns,
+			(check_lane(mv, prog, lin, lout, tin, out, samples, 0) ||
+			check_lane(mv, prog, lin, lout, tin, out, samples, MV_LANES-1)) ?
+			'*' : ' ');
+		fprintf(stdout, " %7d %5d %4d %4d", mv->dec.maxblk, mv->dec.ring,
+			mv->dec.dead, mv->dec.skip);
+		
+		/* a long silence after the input settles to the idle state */
+		ns = run_idle(mv, pv, prog, in, samples);
+		nidle += ns > 0;
+		fprintf(stdout, " %5.1f%c\n", ns < 0 ? 0 : ns, ns < 0 ? '*' : ' ');
+	}
+	
+	fprintf(stdout, "mean");
+	for(e=0;e<NUM_ENG;e++)
+		fprintf(stdout, " %9.1f ", tot[e]/63);
+	fprintf(stdout, " %9.1f \n", ltot/63);
+	fprintf(stdout, "jit compile %.1f us/program\n", jit_ns/63/1000);
+	fprintf(stdout, "%d of 63 programs idle in silence\n", nidle);
+	
+	mvjit_Free(&jit);	
+	free(ring);
+	free(lout);
+	free(lin);
+	free(ml);
+	free(tin);
+	free(out);
+	free(ref);
+	free(in);
+	free(pv);
+	free(mv);
+	
+	/* the fast path must come on somewhere */
+	if(!nidle)
+	{
+		fprintf(stderr, "No program went idle in silence\n");
+		exit(1);
+	}
+	exit(0);
+}
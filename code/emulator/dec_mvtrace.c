@@ -0,0 +1,46 @@
+/* dec_mvtrace.c - convert a binary midiverb trace to text */
+/* 10-17-26 E. Brombaugh */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mv_trace.h"
+
+int main(int argc, char **argv)
+{
+	char *iname = "output.mvt", *oname = "output.txt";
+	FILE *ifile, *ofile;
+	
+	/* override defaults */
+	if(argc > 1)
+		iname = argv[1];
+	
+	if(argc > 2)
+		oname = argv[2];
+	
+	/* open files */
+	if(!(ifile = fopen(iname, "rb")))
+	{
+		fprintf(stderr, "Couldn't open input file %s for read\n", iname);
+		exit(1);
+	}
+	
+	if(!(ofile = fopen(oname, "w")))
+	{
+		fprintf(stderr, "Couldn't open output file %s for write\n", oname);
+		fclose(ifile);
+		exit(1);
+	}
+	
+	if(mvtrace_Text(ifile, ofile))
+	{
+		fprintf(stderr, "%s is not a midiverb trace.\n", iname);
+		fclose(ofile);
+		fclose(ifile);
+		exit(1);
+	}
+	
+	/* done */
+	fclose(ofile);
+	fclose(ifile);
+	exit(0);
+}
@@ -3,39 +3,424 @@
  * 07-31-2021 E. Brombaugh
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "midiverb.h"
 #include "mv_ucode.h"
 
+/* threaded interpreter handlers */
+enum
+{
+	TH_ADC_ADD, TH_ADC_LD,
+	TH_SUMHALF, TH_LDHALF, TH_STRPOS, TH_STRNEG,
+	TH_ACCPOS, TH_ACCNEG, TH_SKIP,
+	TH_DACR_RD, TH_DACR_POS, TH_DACR_NEG,
+	TH_DACL_RD, TH_DACL_POS, TH_DACL_NEG,
+	TH_END,
+};
+
+static void midiverb_BlockThreaded(mvblk *blk, const int16_t *in,
+	int16_t *out, size_t frames, const void *const **handlers);
+static void midiverb_Liveness(mvdec *dec, uint8_t *skip);
+
 /*
  * Initialize a Midiverb entity
  */
 void midiverb_Init(mvblk *blk)
 {
-	uint16_t i;
-	
+	midiverb_InitRing(blk, 16384);
+}
+
+/*
+ * Initialize a Midiverb entity whose DRAM holds only a power-of-two ring
+ * of the given size, i.e. it was allocated with MV_BLKSIZE(ring) bytes
+ */
+void midiverb_InitRing(mvblk *blk, uint16_t ring)
+{
 	/* init state */
 	blk->prog = 255;
-	blk->dfile = NULL;
+#ifdef MV_TRACE
+	blk->trace = NULL;
+#endif
 	blk->acc = 0;
 	blk->asum = 0;
+	blk->mask = ring - 1;
+	blk->engine = MV_ENG_DECODED;
+	blk->idle = 0;
+	blk->quiet = 0;
+	blk->nexec = 0;
+	blk->nidle = 0;
 	
 	/* clear data memory */
-	memset(blk->dram, 0, 16384*sizeof(int16_t));
+	memset(blk->dram, 0, ring*sizeof(int16_t));
 }
 
 /*
- * Set program
+ * Allocate & init an entity with the smallest DRAM ring that runs a
+ * program bit-exact. Release it with free().
+ */
+mvblk *midiverb_Alloc(uint8_t prog)
+{
+	mvdec dec;
+	mvblk *blk;
+	uint16_t ring = 16384;
+	
+	if(prog <= 62)
+	{
+		midiverb_Decode(&dec, &mv_ucode[prog<<7]);
+		ring = dec.ring;
+	}
+	
+	if(!(blk = malloc(MV_BLKSIZE(ring))))
+		return NULL;
+	midiverb_InitRing(blk, ring);
+	midiverb_SetProg(blk, prog);
+	
+	return blk;
+}
+
+/*
+ * Set program - not while another thread runs the entity, mv_switch.c
+ * changes programs from a control thread
  */
 void midiverb_SetProg(mvblk *blk, uint8_t prog)
 {
+	midiverb_Wake(blk);
 	blk->prog = prog;
+	
+	/* decode once here rather than on every sample */
+	if(prog <= 62)
+	{
+		midiverb_Decode(&blk->dec, &mv_ucode[prog<<7]);
+		
+		/* a short ring can't run programs with longer taps */
+		if(blk->dec.ring > blk->mask + 1)
+			blk->prog = 255;
+	}
+}
+
+/*
+ * Get the microcode for a program
+ */
+const uint16_t *midiverb_Ucode(uint8_t prog)
+{
+	return &mv_ucode[prog<<7];
+}
+
+/*
+ * Format one program's 256 raw ROM bytes into 128 depipelined words,
+ * same as mk_mvucode does for the whole ROM
+ */
+void midiverb_Depipeline(uint16_t *ucode, const uint8_t *rom)
+{
+	uint16_t i, op, addr;
+	
+	for(i=0;i<128;i++)
+	{
+		op = (rom[(i*2-3)&0xff] >> 6) & 0x03;
+		addr = rom[(i*2-2)&0xff] + ((rom[(i*2-1)&0xff] & 0x3f) << 8);
+		ucode[i] = (op<<14) + addr;
+	}
+}
+
+/*
+ * Select execution engine used by midiverb_ProcBlock()
+ */
+void midiverb_SetEngine(mvblk *blk, uint8_t engine)
+{
+	blk->engine = engine;
+}
+
+/*
+ * Decode one 128-word program into struct-of-arrays masks, less the
+ * writes no read ever sees
+ */
+void midiverb_Decode(mvdec *dec, const uint16_t *ucode)
+{
+	uint16_t asum = 0;
+	uint8_t i, op, skip[128];
+	
+	for(i=0;i<128;i++)
+	{
+		op = (ucode[i] >> 14) & 0x3;
+		
+		/* running sum of increments, so no serial address chain */
+		dec->off[i] = asum;
+		asum = (asum + ucode[i])&0x3fff;
+		
+		/* ops 0,1 read DRAM, 2 reads acc, 3 reads ~acc */
+		dec->rd[i] = (op&2) ? 0 : -1;
+		dec->inv[i] = (op==3) ? -1 : 0;
+		
+		/* ops 2,3 write DRAM */
+		dec->wr[i] = (op&2) ? -1 : 0;
+		
+		/* odd ops clear acc before summing */
+		dec->keep[i] = (op&1) ? 0 : -1;
+	}
+	dec->sum = asum;
+	dec->maxblk = midiverb_MaxBlock(dec);
+	dec->ring = midiverb_RingSize(dec);
+	midiverb_Liveness(dec, skip);
+	
+#if defined(__GNUC__)
+	/* each instruction carries its threaded handler address */
+	{
+		const void *const *h;
+		
+		midiverb_BlockThreaded(NULL, NULL, NULL, 0, &h);
+		for(i=0;i<128;i++)
+		{
+			op = (ucode[i] >> 14) & 0x3;
+			if(skip[i])
+				dec->thr[i] = h[TH_SKIP];
+			else if(i==0)
+				dec->thr[i] = h[TH_ADC_ADD + (op&1)];
+			else if(i==0x60)
+				dec->thr[i] = h[TH_DACR_RD + ((op&2) ? (op&1) + 1 : 0)];
+			else if(i==0x70)
+				dec->thr[i] = h[TH_DACL_RD + ((op&2) ? (op&1) + 1 : 0)];
+			else if((op&2) && !dec->wr[i])
+				dec->thr[i] = h[TH_ACCPOS + (op&1)];
+			else
+				dec->thr[i] = h[TH_SUMHALF + op];
+		}
+		dec->thr[128] = h[TH_END];
+	}
+#endif
+}
+
+/*
+ * Find the largest number of samples B that can be run instruction-major,
+ * i.e. each instruction over B consecutive samples before the next one.
+ * Returns 0 if the acc carries state from one sample into the next.
+ */
+uint16_t midiverb_MaxBlock(const mvdec *dec)
+{
+	uint8_t delta[16384];
+	uint16_t t;
+	uint8_t i, j;
+	
+	/* acc must be cleared before anything reads it in each sample */
+	for(i=0;i<128;i++)
+	{
+		/* reading acc onto AI bus before it's cleared */
+		if(i && !dec->rd[i])
+			return 0;
+		
+		/* DAC slots don't update acc */
+		if((i!=0x60) && (i!=0x70) && !dec->keep[i])
+			break;
+	}
+	if(i==128)
+		return 0;
+	
+	/*
+	 * Instruction i of sample m and instruction j<i of sample m+t hit the
+	 * same address when t*sum = off[i]-off[j]. Running instruction-major
+	 * swaps their order, which is only legal if neither one writes.
+	 */
+	memset(delta, 0, sizeof(delta));
+	for(i=1;i<128;i++)
+		for(j=0;j<i;j++)
+			if(!j || dec->wr[i] || dec->wr[j])
+				delta[(dec->off[i] - dec->off[j])&0x3fff] = 1;
+	
+	/* samples up to t-1 apart may share a block */
+	for(t=1;t<MV_MAXBLOCK;t++)
+		if(delta[(t*dec->sum)&0x3fff])
+			break;
+	
+	return t;
+}
+
+/*
+ * Smallest t >= 0 with t*sum = d modulo the ring mask+1, or 0xffff if
+ * there's none. Further solutions follow every *period samples.
+ */
+static uint16_t midiverb_Steps(uint16_t sum, uint16_t d, uint16_t mask,
+	uint16_t *period)
+{
+	uint32_t g, a, x;
+	
+	sum &= mask;
+	d &= mask;
+	if(!sum)
+	{
+		*period = 1;
+		return d ? 0xffff : 0;
+	}
+	
+	/* gcd with a power of two is sum's lowest set bit */
+	g = sum & -sum;
+	if(d & (g-1))
+		return 0xffff;
+	*period = (mask+1)/g;
+	
+	/* inverse of odd a, each Newton step doubles the good bits */
+	a = sum/g;
+	x = a;
+	x = (x * (2 - a*x)) & 0xffff;
+	x = (x * (2 - a*x)) & 0xffff;
+	x = (x * (2 - a*x)) & 0xffff;
+	
+	return ((d/g) * x) & (*period - 1);
+}
+
+/*
+ * Samples back to the first write by instruction k that instruction j sees
+ * at the same address modulo the ring mask+1, or 0xffff if there's none
+ */
+static uint16_t midiverb_Age(const mvdec *dec, uint8_t j, uint8_t k,
+	uint16_t mask)
+{
+	uint16_t t, period;
+	
+	t = midiverb_Steps(dec->sum, dec->off[k] - dec->off[j], mask, &period);
+	
+	/* within a sample only earlier instructions have written yet */
+	if((t == 0) && (k >= j))
+		t = period;
+	
+	return t;
+}
+
+/*
+ * Latest write each read sees in the full ring, as samples back in age[]
+ * and instruction in src[], age 0xffff if it only sees the initial 0.
+ * ADC always writes.
+ */
+static void midiverb_Sees(const mvdec *dec, uint16_t *age, uint8_t *src)
+{
+	uint16_t t;
+	uint8_t j, k;
+	
+	for(j=1;j<128;j++)
+	{
+		age[j] = 0xffff;
+		src[j] = 0;
+		if(!dec->rd[j])
+			continue;
+		for(k=0;k<128;k++)
+		{
+			if(k && !dec->wr[k])
+				continue;
+			t = midiverb_Age(dec, j, k, 0x3fff);
+			if(t == 0xffff)
+				continue;
+			if((t < age[j]) || ((t == age[j]) && (k > src[j])))
+			{
+				age[j] = t;
+				src[j] = k;
+			}
+		}
+	}
+}
+
+/*
+ * Find the smallest power-of-two DRAM ring that gives bit-exact results,
+ * i.e. where no read ever sees another address's write that aliases onto
+ * the one it reads in the full 16384-word ring
+ */
+uint16_t midiverb_RingSize(const mvdec *dec)
+{
+	uint16_t age[128], t, lo, hi, mid;
+	uint8_t src[128], j, k;
+	int ok;
+	
+	midiverb_Sees(dec, age, src);
+	
+	/* a ring that works also works doubled, so search on log2 size */
+	lo = 0;
+	hi = 14;
+	while(lo < hi)
+	{
+		mid = (lo + hi)/2;
+		ok = 1;
+		for(j=1;ok && (j<128);j++)
+		{
+			if(!dec->rd[j])
+				continue;
+			for(k=0;ok && (k<128);k++)
+			{
+				if(k && !dec->wr[k])
+					continue;
+				
+				/* any aliased write after the real one clobbers it */
+				t = midiverb_Age(dec, j, k, (1<<mid) - 1);
+				if(t == 0xffff)
+					continue;
+				if((t < age[j]) || ((t == age[j]) && (k > src[j])))
+					ok = 0;
+			}
+		}
+		if(ok)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	
+	return 1<<lo;
+}
+
+/*
+ * Drop the writes no read ever sees from wr[] and flag in skip[] the
+ * instructions left with nothing live, no write, DAC or acc anything
+ * reads. Run after maxblk & ring, which count every write so they still
+ * hold for the engines that do them all.
+ */
+static void midiverb_Liveness(mvdec *dec, uint8_t *skip)
+{
+	uint16_t age[128];
+	uint8_t src[128], seen[128], after[128], live, end, dac, use;
+	int i;
+	
+	/* a write is live if some read's latest write is it */
+	midiverb_Sees(dec, age, src);
+	memset(seen, 0, sizeof(seen));
+	for(i=1;i<128;i++)
+		if(dec->rd[i] && (age[i] != 0xffff))
+			seen[src[i]] = 1;
+	dec->dead = 0;
+	for(i=1;i<128;i++)
+		if(dec->wr[i] && !seen[i])
+		{
+			dec->wr[i] = 0;
+			dec->dead++;
+		}
+	
+	/* acc live after each instruction, around the sample until it settles */
+	end = 0;
+	for(;;)
+	{
+		live = end;
+		for(i=127;i>=0;i--)
+		{
+			after[i] = live;
+			dac = (i==0x60) || (i==0x70);
+			
+			/* AI goes to DRAM, a DAC or the acc, which DACs pass on */
+			use = !i || dec->wr[i] || dac || live;
+			live = (i && !dec->rd[i] && use) ||
+				((dac || dec->keep[i]) && live);
+		}
+		if(live == end)
+			break;
+		end = live;
+	}
+	
+	dec->skip = 0;
+	for(i=0;i<128;i++)
+	{
+		skip[i] = i && (i!=0x60) && (i!=0x70) && !dec->wr[i] && !after[i];
+		dec->skip += skip[i];
+	}
 }
 
 /*
  * process one sample
  */
-void midiverb_Proc(mvblk *blk, int16_t *in, int16_t *out)
+void midiverb_Proc(mvblk *blk, const int16_t *in, int16_t *out)
 {
 	uint16_t addr, instr;
 	int16_t ai, sat;
@@ -49,6 +434,9 @@ void midiverb_Proc(mvblk *blk, int16_t *in, int16_t *out)
 		return;
 	}
 	
+	/* the silence tracker in midiverb_ProcBlock() doesn't see this sample */
+	midiverb_Wake(blk);
+	
 	/* loop over microcode */
 	for(i=0;i<128;i++)
 	{
@@ -70,7 +458,7 @@ void midiverb_Proc(mvblk *blk, int16_t *in, int16_t *out)
 				case 0:
 				case 1:
 					/* read DRAM */
-					ai = blk->dram[blk->asum];
+					ai = blk->dram[blk->asum & blk->mask];
 					break;
 				
 				case 2:
@@ -99,21 +487,15 @@ void midiverb_Proc(mvblk *blk, int16_t *in, int16_t *out)
 			out[(i==0x60) ? 1 : 0] = sat << 3;
 		}
 		
-		/* diagnositcs */
-		if(blk->dfile)
-		{
-			fprintf(blk->dfile, "%02x ", i);
-			fprintf(blk->dfile, "%1x ", op);
-			fprintf(blk->dfile, "%04x ", addr);
-			fprintf(blk->dfile, "%04x ", blk->asum);
-			fprintf(blk->dfile, "%04x ", ai&0xffff);
-			fprintf(blk->dfile, "%04x ", blk->acc&0xffff);
-			fprintf(blk->dfile, "\n");
-		}
+#ifdef MV_TRACE
+		/* diagnostics */
+		if(blk->trace)
+			mvtrace_Rec(blk->trace, i, op, addr, blk->asum, ai, blk->acc);
+#endif
 		
 		/* DRAM write */
 		if((op&2) || (i==0))
-			blk->dram[blk->asum] = ai;
+			blk->dram[blk->asum & blk->mask] = ai;
 		
 		/* update Accumulator */
 		if((i!=0x60) && (i!=0x70))
@@ -124,3 +506,563 @@ void midiverb_Proc(mvblk *blk, int16_t *in, int16_t *out)
 	}
 }
 
+
+/*
+ * block engine - interpret raw microcode
+ */
+static void midiverb_BlockSwitch(mvblk *blk, const int16_t *in, int16_t *out,
+	size_t frames)
+{
+	const uint16_t *ucode;
+	int16_t *dram = blk->dram;
+	uint16_t addr, asum, mask = blk->mask;
+	int16_t ai, acc, sat;
+	uint8_t i, op;
+	
+	/* keep state local for the whole block */
+	ucode = &mv_ucode[blk->prog<<7];
+	acc = blk->acc;
+	asum = blk->asum;
+	
+	while(frames--)
+	{
+		/* instr 0 always writes the scaled & mixed input to DRAM */
+		op = (ucode[0] >> 14) & 0x3;
+		ai = ((in[0]>>4) + (in[1]>>4)) & 0xFFFE;
+		dram[asum & mask] = ai;
+		acc = (ai>>1) + ((op & 1) ? 0 : acc) + ((ai < 0) ? 1 : 0);
+		asum = (asum + (ucode[0] & 0x3fff))&0x3fff;
+		
+		/* remaining microcode */
+		for(i=1;i<128;i++)
+		{
+			op = (ucode[i] >> 14) & 0x3;
+			addr = ucode[i] & 0x3fff;
+			
+			/* Drive AI bus */
+			switch(op)
+			{
+				case 0:
+				case 1:
+					ai = dram[asum & mask];
+					break;
+				
+				case 2:
+					ai = acc;
+					break;
+				
+				case 3:
+					ai = ~acc;
+					break;
+			}
+			
+			/* DRAM write */
+			if(op&2)
+				dram[asum & mask] = ai;
+			
+			/* grab outputs, otherwise update accumulator */
+			if((i==0x60)||(i==0x70))
+			{
+				sat = ai;
+				if(sat > 4095)
+					sat = 4095;
+				else if(sat < -4096)
+					sat = -4096;
+				out[(i==0x60) ? 1 : 0] = sat << 3;
+			}
+			else
+				acc = (ai>>1) + ((op & 1) ? 0 : acc) + ((ai < 0) ? 1 : 0);
+			
+			/* update address */
+			asum = (asum + addr)&0x3fff;
+		}
+		
+		in += 2;
+		out += 2;
+	}
+	
+	/* save state */
+	blk->acc = acc;
+	blk->asum = asum;
+}
+
+/*
+ * run decoded instructions [start, end). The rd & wr tests stay branches:
+ * they are fixed per program and predict well, where masked selects put a
+ * load, a store and the acc chain on every instruction.
+ */
+static inline int16_t midiverb_Seg(const mvdec *dec, int16_t *dram,
+	uint16_t mask, uint8_t start, uint8_t end, int16_t acc, uint16_t asum)
+{
+	uint16_t a;
+	int16_t ai;
+	uint8_t i;
+	
+	for(i=start;i<end;i++)
+	{
+		a = (asum + dec->off[i])&mask;
+		ai = dec->rd[i] ? dram[a] : acc ^ dec->inv[i];
+		if(dec->wr[i])
+			dram[a] = ai;
+		acc = (ai>>1) + (acc & dec->keep[i]) + ((uint16_t)ai >> 15);
+	}
+	
+	return acc;
+}
+
+/*
+ * DAC slot - drive AI & DRAM as usual, output instead of acc update
+ */
+static inline int16_t midiverb_Dac(const mvdec *dec, int16_t *dram,
+	uint16_t mask, uint8_t i, int16_t acc, uint16_t asum)
+{
+	uint16_t a;
+	int16_t ai;
+	
+	a = (asum + dec->off[i])&mask;
+	ai = dec->rd[i] ? dram[a] : acc ^ dec->inv[i];
+	if(dec->wr[i])
+		dram[a] = ai;
+	
+	/* saturate & scale */
+	if(ai > 4095)
+		ai = 4095;
+	else if(ai < -4096)
+		ai = -4096;
+	return ai << 3;
+}
+
+/*
+ * block engine - run the program decoded by midiverb_SetProg()
+ */
+static void midiverb_BlockDecoded(mvblk *blk, const int16_t *in,
+	int16_t *out, size_t frames)
+{
+	const mvdec *dec = &blk->dec;
+	int16_t *dram = blk->dram;
+	uint16_t asum, mask = blk->mask;
+	int16_t ai, acc;
+	
+	acc = blk->acc;
+	asum = blk->asum;
+	
+	while(frames--)
+	{
+		/* ADC slot - offset 0 is always the sample base */
+		ai = ((in[0]>>4) + (in[1]>>4)) & 0xFFFE;
+		dram[asum & mask] = ai;
+		acc = (ai>>1) + (acc & dec->keep[0]) + ((uint16_t)ai >> 15);
+		
+		/* DAC slots split the rest into three runs */
+		acc = midiverb_Seg(dec, dram, mask, 0x01, 0x60, acc, asum);
+		out[1] = midiverb_Dac(dec, dram, mask, 0x60, acc, asum);
+		acc = midiverb_Seg(dec, dram, mask, 0x61, 0x70, acc, asum);
+		out[0] = midiverb_Dac(dec, dram, mask, 0x70, acc, asum);
+		acc = midiverb_Seg(dec, dram, mask, 0x71, 0x80, acc, asum);
+		
+		/* advance base once per sample */
+		asum = (asum + dec->sum)&0x3fff;
+		in += 2;
+		out += 2;
+	}
+	
+	blk->acc = acc;
+	blk->asum = asum;
+}
+
+/*
+ * block engine - direct-threaded, each decoded instruction jumps straight
+ * to the next one's handler. Called with handlers != NULL it only returns
+ * the handler table for midiverb_Decode().
+ */
+static void midiverb_BlockThreaded(mvblk *blk, const int16_t *in,
+	int16_t *out, size_t frames, const void *const **handlers)
+{
+#if defined(__GNUC__)
+	static const void *const h[] =
+	{
+		[TH_ADC_ADD] = &&adc_add, [TH_ADC_LD] = &&adc_ld,
+		[TH_SUMHALF] = &&sumhalf, [TH_LDHALF] = &&ldhalf,
+		[TH_STRPOS] = &&strpos, [TH_STRNEG] = &&strneg,
+		[TH_ACCPOS] = &&accpos, [TH_ACCNEG] = &&accneg, [TH_SKIP] = &&skip,
+		[TH_DACR_RD] = &&dacr_rd, [TH_DACR_POS] = &&dacr_pos,
+		[TH_DACR_NEG] = &&dacr_neg,
+		[TH_DACL_RD] = &&dacl_rd, [TH_DACL_POS] = &&dacl_pos,
+		[TH_DACL_NEG] = &&dacl_neg,
+		[TH_END] = &&end,
+	};
+	const void *const *thr;
+	const uint16_t *off;
+	int16_t *dram, ai, acc;
+	uint16_t asum, mask;
+	uint8_t i;
+	
+	if(handlers)
+	{
+		*handlers = h;
+		return;
+	}
+	if(!frames)
+		return;
+	
+	thr = blk->dec.thr;
+	off = blk->dec.off;
+	dram = blk->dram;
+	mask = blk->mask;
+	acc = blk->acc;
+	asum = blk->asum;
+	
+/* AI from DRAM or acc, acc update, next instruction */
+#define TH_MEM	dram[(asum + off[i])&mask]
+#define TH_ACC(keep) \
+	acc = (ai>>1) + (keep) + ((uint16_t)ai >> 15)
+#define TH_NEXT	goto *thr[++i]
+#define TH_DAC(ch) \
+	if(ai > 4095) \
+		ai = 4095; \
+	else if(ai < -4096) \
+		ai = -4096; \
+	out[ch] = ai << 3
+	
+	i = 0;
+	goto *thr[0];
+	
+adc_add:
+	ai = ((in[0]>>4) + (in[1]>>4)) & 0xFFFE;
+	dram[asum & mask] = ai;
+	TH_ACC(acc);
+	TH_NEXT;
+	
+adc_ld:
+	ai = ((in[0]>>4) + (in[1]>>4)) & 0xFFFE;
+	dram[asum & mask] = ai;
+	TH_ACC(0);
+	TH_NEXT;
+	
+sumhalf:
+	ai = TH_MEM;
+	TH_ACC(acc);
+	TH_NEXT;
+	
+ldhalf:
+	ai = TH_MEM;
+	TH_ACC(0);
+	TH_NEXT;
+	
+strpos:
+	ai = acc;
+	TH_MEM = ai;
+	TH_ACC(acc);
+	TH_NEXT;
+	
+strneg:
+	ai = ~acc;
+	TH_MEM = ai;
+	TH_ACC(0);
+	TH_NEXT;
+	
+accpos:
+	ai = acc;
+	TH_ACC(acc);
+	TH_NEXT;
+	
+accneg:
+	ai = ~acc;
+	TH_ACC(0);
+	TH_NEXT;
+	
+skip:
+	TH_NEXT;
+	
+dacr_rd:
+	ai = TH_MEM;
+	TH_DAC(1);
+	TH_NEXT;
+	
+dacr_pos:
+	ai = acc;
+	TH_MEM = ai;
+	TH_DAC(1);
+	TH_NEXT;
+	
+dacr_neg:
+	ai = ~acc;
+	TH_MEM = ai;
+	TH_DAC(1);
+	TH_NEXT;
+	
+dacl_rd:
+	ai = TH_MEM;
+	TH_DAC(0);
+	TH_NEXT;
+	
+dacl_pos:
+	ai = acc;
+	TH_MEM = ai;
+	TH_DAC(0);
+	TH_NEXT;
+	
+dacl_neg:
+	ai = ~acc;
+	TH_MEM = ai;
+	TH_DAC(0);
+	TH_NEXT;
+	
+end:
+	asum = (asum + blk->dec.sum)&0x3fff;
+	in += 2;
+	out += 2;
+	if(--frames)
+	{
+		i = 0;
+		goto *thr[0];
+	}
+	
+#undef TH_MEM
+#undef TH_ACC
+#undef TH_NEXT
+#undef TH_DAC
+	
+	blk->acc = acc;
+	blk->asum = asum;
+#endif
+}
+
+/*
+ * Samples before the DRAM addresses a program uses repeat
+ */
+uint32_t midiverb_Period(const mvblk *blk)
+{
+	uint32_t sum = blk->dec.sum & blk->mask;
+	
+	return sum ? (blk->mask + 1)/(sum & -sum) : 1;
+}
+
+/*
+ * The writes one engine makes, the switch engine keeps the dead ones
+ */
+static int16_t midiverb_Writes(const mvblk *blk, uint8_t i)
+{
+	return (blk->engine == MV_ENG_SWITCH) ? ~blk->dec.rd[i] : blk->dec.wr[i];
+}
+
+/*
+ * reverse n DRAM words g apart from x
+ */
+static void midiverb_Reverse(int16_t *x, uint16_t g, uint32_t n)
+{
+	uint32_t j, k;
+	int16_t t;
+	
+	for(j=0,k=(n-1)*g;n>1;j+=g,k-=g,n-=2)
+	{
+		t = x[j];
+		x[j] = x[k];
+		x[k] = t;
+	}
+}
+
+/*
+ * bring the DRAM of an idle instance up to its address. In the steady
+ * state every word the program writes holds the same value relative to
+ * the address, so the skipped samples just turn each strand of the ring
+ * that is written, the words g apart, on by the distance moved.
+ */
+void midiverb_Sync(mvblk *blk)
+{
+	const mvdec *dec = &blk->dec;
+	uint16_t res[128], g, r, d, sum = dec->sum & blk->mask;
+	uint32_t n, s;
+	uint8_t i, j, nres = 0;
+	
+	d = (blk->asum - blk->iasum) & blk->mask;
+	if(!blk->idle || !d)
+		return;
+	blk->iasum = blk->asum;
+	
+	/* the strands written, the ADC slot writes at the address itself */
+	g = sum & -sum;
+	for(i=0;i<128;i++)
+	{
+		if(i && !midiverb_Writes(blk, i))
+			continue;
+		r = (blk->asum - d + (i ? dec->off[i] : 0)) & (g - 1);
+		for(j=0;(j<nres) && (res[j] != r);j++);
+		if(j == nres)
+			res[nres++] = r;
+	}
+	
+	/* rotate each strand right by d/g, as three reversals */
+	n = (blk->mask + 1)/g;
+	s = d/g;
+	for(j=0;j<nres;j++)
+	{
+		midiverb_Reverse(&blk->dram[res[j]], g, n);
+		midiverb_Reverse(&blk->dram[res[j]], g, s);
+		midiverb_Reverse(&blk->dram[res[j] + s*g], g, n - s);
+	}
+}
+
+/*
+ * leave the silent steady state, e.g. before running other input
+ */
+void midiverb_Wake(mvblk *blk)
+{
+	midiverb_Sync(blk);
+	blk->idle = 0;
+	blk->quiet = 0;
+}
+
+/*
+ * block engine - decoded program with silent input, noting whether each
+ * sample puts the same values on the AI bus as the one before and leaves
+ * acc as it found it. Once that has held for a whole address period
+ * every word read next was written or read over the period before, so
+ * the program repeats itself for as long as the input stays zero and
+ * execution stops. Returns samples executed.
+ */
+static size_t midiverb_BlockQuiet(mvblk *blk, int16_t *out, size_t frames)
+{
+	const mvdec *dec = &blk->dec;
+	int16_t *dram = blk->dram, *last = blk->last, wr[128];
+	uint16_t a, asum, mask = blk->mask;
+	uint32_t quiet, period;
+	int16_t ai, acc, acc0, diff;
+	size_t n;
+	uint8_t i;
+	
+	acc = blk->acc;
+	asum = blk->asum;
+	quiet = blk->quiet;
+	period = midiverb_Period(blk);
+	
+	for(i=0;i<128;i++)
+		wr[i] = midiverb_Writes(blk, i);
+	
+	for(n=0;(n<frames) && (quiet<=period);n++)
+	{
+		/* silent ADC slot writes 0 */
+		acc0 = acc;
+		diff = last[0];
+		last[0] = 0;
+		dram[asum & mask] = 0;
+		acc = acc & dec->keep[0];
+		
+		for(i=1;i<128;i++)
+		{
+			a = (asum + dec->off[i])&mask;
+			ai = dec->rd[i] ? dram[a] : acc ^ dec->inv[i];
+			if(wr[i])
+				dram[a] = ai;
+			diff |= last[i] ^ ai;
+			last[i] = ai;
+			
+			/* DAC slots output instead of updating acc */
+			if((i==0x60)||(i==0x70))
+				out[2*n + ((i==0x60) ? 1 : 0)] =
+					(ai > 4095 ? 4095 : (ai < -4096 ? -4096 : ai)) << 3;
+			else
+				acc = (ai>>1) + (acc & dec->keep[i]) + ((uint16_t)ai >> 15);
+		}
+		diff |= acc ^ acc0;
+		
+		/* last[] only holds the sample before once quiet is counting */
+		quiet = (quiet && !diff) ? quiet + 1 : 1;
+		asum = (asum + dec->sum)&0x3fff;
+	}
+	
+	blk->acc = acc;
+	blk->asum = asum;
+	blk->quiet = quiet;
+	if(quiet > period)
+	{
+		blk->idle = 1;
+		blk->iasum = asum;
+	}
+	
+	return n;
+}
+
+/*
+ * check for an all-zero input block
+ */
+static int midiverb_Silent(const int16_t *in, size_t frames)
+{
+	int16_t any = 0;
+	size_t j;
+	
+	for(j=0;j<2*frames;j++)
+		any |= in[j];
+	
+	return !any;
+}
+
+/*
+ * process a block of interleaved stereo frames
+ */
+void midiverb_ProcBlock(mvblk *blk, const int16_t *in, int16_t *out,
+	size_t frames)
+{
+	int16_t l, r;
+	size_t n;
+	
+	/* don't try to execute illegal programs */
+	if(blk->prog > 62)
+	{
+		memset(out, 0, frames*2*sizeof(int16_t));
+		return;
+	}
+	
+	/* diagnostics are only available one sample at a time */
+	if(MV_TRACING(blk))
+	{
+		while(frames--)
+		{
+			midiverb_Proc(blk, in, out);
+			in += 2;
+			out += 2;
+		}
+		return;
+	}
+	
+	/* silence is watched for a fixed point, then skipped */
+	if(midiverb_Silent(in, frames))
+	{
+		n = blk->idle ? 0 : midiverb_BlockQuiet(blk, out, frames);
+		blk->nexec += n;
+		
+		/* the steady state repeats its DAC values, DRAM catches up later */
+		frames -= n;
+		l = blk->last[0x70];
+		r = blk->last[0x60];
+		l = (l > 4095 ? 4095 : (l < -4096 ? -4096 : l)) << 3;
+		r = (r > 4095 ? 4095 : (r < -4096 ? -4096 : r)) << 3;
+		for(out+=2*n,n=0;n<frames;n++)
+		{
+			out[2*n] = l;
+			out[2*n+1] = r;
+		}
+		blk->asum = (blk->asum + frames*blk->dec.sum)&0x3fff;
+		blk->nidle += frames;
+		return;
+	}
+	midiverb_Wake(blk);
+	blk->nexec += frames;
+	
+	switch(blk->engine)
+	{
+		case MV_ENG_SWITCH:
+			midiverb_BlockSwitch(blk, in, out, frames);
+			break;
+		
+#if defined(__GNUC__)
+		case MV_ENG_THREADED:
+			midiverb_BlockThreaded(blk, in, out, frames, NULL);
+			break;
+#endif
+		
+		default:
+			midiverb_BlockDecoded(blk, in, out, frames);
+			break;
+	}
+}
@@ -8,18 +8,83 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
+#ifdef MV_TRACE
+#include "mv_trace.h"
+#endif
+
+/* execution engines */
+enum
+{
+	MV_ENG_SWITCH,					/* interpret raw microcode */
+	MV_ENG_DECODED,					/* run pre-decoded program tables */
+	MV_ENG_THREADED,				/* direct-threaded, GCC computed goto */
+};
+
+/* longest instruction-major block considered by the analyzer */
+#define MV_MAXBLOCK 256
+
+/* program pre-decoded by midiverb_SetProg() */
+typedef struct
+{
+	uint16_t off[128];				/* address offset from sample base */
+	uint16_t sum;					/* base increment per sample */
+	int16_t rd[128];				/* AI from DRAM (else from acc) mask */
+	int16_t inv[128];				/* invert acc mask */
+	int16_t wr[128];				/* DRAM write enable mask */
+	int16_t keep[128];				/* keep acc (else clear) mask */
+	uint16_t maxblk;				/* longest instruction-major block */
+	uint16_t ring;					/* smallest bit-exact DRAM ring */
+	uint8_t dead;					/* writes no read sees, off in wr */
+	uint8_t skip;					/* instructions with nothing live */
+	const void *thr[129];			/* threaded handler, [128] ends frame */
+} mvdec;
 
 typedef struct
 {
 	uint8_t prog;					/* program index */
-	FILE *dfile;						/* diagnostic file */
+#ifdef MV_TRACE
+	mvtrace *trace;					/* instruction trace */
+#endif
 	int16_t acc;		 			/* accumulator */
 	uint16_t asum;					/* Address Gen */
-	int16_t dram[16384];			/* DRAM data store */
+	uint16_t mask;					/* DRAM ring address mask */
+	uint8_t engine;					/* execution engine */
+	uint8_t idle;					/* silent steady state, not executing */
+	uint16_t iasum;					/* address DRAM was left at when idle */
+	uint32_t quiet;					/* silent samples repeating the last */
+	int16_t last[128];				/* AI values of the last silent sample */
+	uint64_t nexec;					/* samples executed */
+	uint64_t nidle;					/* samples skipped while idle */
+	mvdec dec;						/* decoded program */
+	int16_t dram[16384];			/* DRAM data store, must be last */
 } mvblk;
 
+/* instruction tracing is only compiled in with -DMV_TRACE */
+#ifdef MV_TRACE
+#define MV_TRACING(blk) ((blk)->trace != NULL)
+#else
+#define MV_TRACING(blk) 0
+#endif
+
+/* bytes needed for an instance with a DRAM ring of the given size */
+#define MV_BLKSIZE(ring) (offsetof(mvblk, dram) + (ring)*sizeof(int16_t))
+
 void midiverb_Init(mvblk *blk);
+void midiverb_InitRing(mvblk *blk, uint16_t ring);
+mvblk *midiverb_Alloc(uint8_t prog);
 void midiverb_SetProg(mvblk *blk, uint8_t prog);
-void midiverb_Proc(mvblk *blk, int16_t *in, int16_t *out);
+void midiverb_SetEngine(mvblk *blk, uint8_t engine);
+const uint16_t *midiverb_Ucode(uint8_t prog);
+void midiverb_Depipeline(uint16_t *ucode, const uint8_t *rom);
+void midiverb_Decode(mvdec *dec, const uint16_t *ucode);
+uint16_t midiverb_MaxBlock(const mvdec *dec);
+uint16_t midiverb_RingSize(const mvdec *dec);
+uint32_t midiverb_Period(const mvblk *blk);
+void midiverb_Sync(mvblk *blk);
+void midiverb_Wake(mvblk *blk);
+void midiverb_Proc(mvblk *blk, const int16_t *in, int16_t *out);
+void midiverb_ProcBlock(mvblk *blk, const int16_t *in, int16_t *out,
+	size_t frames);
 
 #endif
@@ -0,0 +1,483 @@
+/*
+ * mk_mvfilt.c - derive biquad tables from the SPICE filter netlists
+ * 10-17-26 E. Brombaugh
+ *
+ * Reads the R, C, V and op-amp (X) lines of a netlist, with the op-amps
+ * taken as ideal, and finds the transfer function from the source marked
+ * AC to node Vout by nodal analysis. The determinant of the nodal matrix
+ * and the output times it are polynomials in s of at most one degree per
+ * capacitor, so both are sampled around a circle in the s plane and the
+ * coefficients recovered with a DFT. Their roots are then grouped into
+ * second order sections in s, which mv_afe.c maps to the running rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <complex.h>
+
+#define MAXNODE 32
+#define MAXELEM 64
+#define MAXDEG 12
+#define MAXSEC (MAXDEG/2 + 1)
+
+typedef struct
+{
+	char type;						/* R, C, V or X */
+	int n[3];						/* R/C/V: a b, X: in+ in- out */
+	double val;						/* ohms, farads, volts */
+} elem;
+
+typedef struct
+{
+	char names[MAXNODE][32];
+	int nnode, nv, nx, ncap, out;
+	elem e[MAXELEM];
+	int nelem;
+} netlist;
+
+/*
+ * node index by name, ground is -1
+ */
+static int node(netlist *nl, const char *name)
+{
+	int i;
+	
+	if(!strcmp(name, "0"))
+		return -1;
+	for(i=0;i<nl->nnode;i++)
+		if(!strcmp(nl->names[i], name))
+			return i;
+	if(nl->nnode == MAXNODE)
+		return -2;
+	snprintf(nl->names[i], sizeof(nl->names[i]), "%s", name);
+	return nl->nnode++;
+}
+
+/*
+ * SPICE number with scale suffix, e.g. 4.7k, 3300pf, 0.01µf
+ */
+static double value(const char *str)
+{
+	char *end;
+	double v = strtod(str, &end);
+	
+	if(!strncasecmp(end, "meg", 3))
+		return v*1e6;
+	if(!strncmp(end, "\xc2\xb5", 2))
+		return v*1e-6;
+	switch(tolower(*end))
+	{
+		case 'f': return v*1e-15;
+		case 'p': return v*1e-12;
+		case 'n': return v*1e-9;
+		case 'u': return v*1e-6;
+		case 'm': return v*1e-3;
+		case 'k': return v*1e3;
+		case 'g': return v*1e9;
+		case 't': return v*1e12;
+	}
+	return v;
+}
+
+/*
+ * parse a netlist, returns 1 on error
+ */
+static int parse(const char *fname, netlist *nl)
+{
+	char line[512], *tok[16];
+	FILE *file;
+	elem *e;
+	int i, ntok, ac = 0;
+	
+	if(!(file = fopen(fname, "r")))
+	{
+		fprintf(stderr, "Couldn't open netlist %s for read\n", fname);
+		return 1;
+	}
+	
+	memset(nl, 0, sizeof(netlist));
+	nl->out = -2;
+	while(fgets(line, sizeof(line), file))
+	{
+		for(ntok=0;ntok<16;ntok++)
+			if(!(tok[ntok] = strtok(ntok ? NULL : line, " \t\r\n")))
+				break;
+		if(!ntok || (tok[0][0] == '*') || (tok[0][0] == '.'))
+			continue;
+	
+		if(nl->nelem == MAXELEM)
+			break;
+		e = &nl->e[nl->nelem++];
+		e->type = toupper(tok[0][0]);
+		switch(e->type)
+		{
+			case 'R':
+			case 'C':
+			case 'V':
+				if(ntok < 4)
+					goto bad;
+				e->n[0] = node(nl, tok[1]);
+				e->n[1] = node(nl, tok[2]);
+	
+				/* supplies are AC ground, the AC source drives the input */
+				e->val = 0;
+				if(e->type != 'V')
+					e->val = value(tok[3]);
+				for(i=3;i<ntok;i++)
+					if(!strcasecmp(tok[i], "AC"))
+						e->val = 1, ac++;
+				if(e->type == 'C')
+					nl->ncap++;
+				if(e->type == 'V')
+					nl->nv++;
+				break;
+	
+			case 'X':
+				/* op-amp pins are in+ in- V+ V- out */
+				if(ntok < 7)
+					goto bad;
+				e->n[0] = node(nl, tok[1]);
+				e->n[1] = node(nl, tok[2]);
+				e->n[2] = node(nl, tok[5]);
+				nl->nx++;
+				break;
+	
+			default:
+				goto bad;
+		}
+		for(i=0;i<3;i++)
+			if(e->n[i] < -1)
+				goto bad;
+	}
+	fclose(file);
+	
+	for(i=0;i<nl->nnode;i++)
+		if(!strcasecmp(nl->names[i], "Vout"))
+			nl->out = i;
+	if((nl->out < 0) || (ac != 1) || (nl->ncap > MAXDEG) ||
+		(nl->nnode + nl->nv + nl->nx > MAXNODE))
+	{
+		fprintf(stderr, "%s needs one AC source, node Vout and at most %d "
+			"capacitors\n", fname, MAXDEG);
+		return 1;
+	}
+	return 0;
+	
+bad:
+	fprintf(stderr, "Unsupported line in %s: %s\n", fname, tok[0]);
+	fclose(file);
+	return 1;
+}
+
+/*
+ * solve the nodal equations at s, returns the determinant and sets the
+ * output voltage
+ */
+static double complex solve(netlist *nl, double complex s, double complex *vout)
+{
+	double complex a[MAXNODE][MAXNODE+1], y, t, det = 1;
+	int n = nl->nnode + nl->nv + nl->nx, i, j, k, p, v = 0, x = 0;
+	elem *e;
+	
+	memset(a, 0, sizeof(a));
+	for(k=0;k<nl->nelem;k++)
+	{
+		e = &nl->e[k];
+		switch(e->type)
+		{
+			case 'R':
+			case 'C':
+				y = e->type == 'R' ? 1/e->val : s*e->val;
+				if(e->n[0] >= 0)
+					a[e->n[0]][e->n[0]] += y;
+				if(e->n[1] >= 0)
+					a[e->n[1]][e->n[1]] += y;
+				if((e->n[0] >= 0) && (e->n[1] >= 0))
+				{
+					a[e->n[0]][e->n[1]] -= y;
+					a[e->n[1]][e->n[0]] -= y;
+				}
+				break;
+	
+			case 'V':
+				/* branch current and V(a) - V(b) = val */
+				i = nl->nnode + v++;
+				if(e->n[0] >= 0)
+					a[e->n[0]][i] += 1, a[i][e->n[0]] += 1;
+				if(e->n[1] >= 0)
+					a[e->n[1]][i] -= 1, a[i][e->n[1]] -= 1;
+				a[i][n] = e->val;
+				break;
+	
+			case 'X':
+				/* output current is free, V(in+) = V(in-) */
+				i = nl->nnode + nl->nv + x++;
+				if(e->n[2] >= 0)
+					a[e->n[2]][i] += 1;
+				if(e->n[0] >= 0)
+					a[i][e->n[0]] += 1;
+				if(e->n[1] >= 0)
+					a[i][e->n[1]] -= 1;
+				break;
+		}
+	}
+	
+	/* elimination with partial pivoting, det is the pivot product */
+	for(k=0;k<n;k++)
+	{
+		for(p=k,i=k+1;i<n;i++)
+			if(cabs(a[i][k]) > cabs(a[p][k]))
+				p = i;
+		if(p != k)
+		{
+			for(j=k;j<=n;j++)
+				t = a[k][j], a[k][j] = a[p][j], a[p][j] = t;
+			det = -det;
+		}
+		det *= a[k][k];
+		if(a[k][k] == 0)
+			return 0;
+		for(i=k+1;i<n;i++)
+		{
+			t = a[i][k]/a[k][k];
+			for(j=k;j<=n;j++)
+				a[i][j] -= t*a[k][j];
+		}
+	}
+	for(k=n-1;k>=0;k--)
+	{
+		for(t=a[k][n],j=k+1;j<n;j++)
+			t -= a[k][j]*a[j][n];
+		a[k][n] = t/a[k][k];
+	}
+	*vout = a[nl->out][n];
+	return det;
+}
+
+/*
+ * roots of c[0] + c[1]u + ... + c[deg]u^deg by Durand-Kerner
+ */
+static void roots(const double *c, int deg, double complex *r)
+{
+	double complex p, q, z0 = 0.4 + 0.9*I;
+	int i, j, it;
+	
+	for(i=0;i<deg;i++)
+		r[i] = cpow(z0, i);
+	for(it=0;it<1000;it++)
+	{
+		for(i=0;i<deg;i++)
+		{
+			for(p=c[deg],j=deg-1;j>=0;j--)
+				p = p*r[i] + c[j];
+			for(q=c[deg],j=0;j<deg;j++)
+				if(j != i)
+					q *= r[i] - r[j];
+			r[i] -= p/q;
+		}
+	}
+}
+
+/*
+ * group roots into real quadratics and at most one linear factor, each
+ * as {c0, c1, c2} in u, sorted by rising Q. Returns factor count.
+ */
+static int factor(double complex *r, int deg, double f[][3])
+{
+	int i, j, n = 0, used[MAXDEG] = {0};
+	double t[3];
+	
+	/* complex pairs first */
+	for(i=0;i<deg;i++)
+		if(!used[i] && (fabs(cimag(r[i])) > 1e-9*cabs(r[i])))
+		{
+			for(j=i+1;j<deg;j++)
+				if(!used[j] && (cabs(r[j] - conj(r[i])) < 1e-6*cabs(r[i])))
+					break;
+			if(j == deg)
+				continue;
+			used[i] = used[j] = 1;
+			f[n][0] = creal(r[i]*conj(r[i]));
+			f[n][1] = -2*creal(r[i]);
+			f[n++][2] = 1;
+		}
+	
+	/* then real roots, two at a time */
+	for(i=0;i<deg;i++)
+		if(!used[i])
+		{
+			used[i] = 1;
+			for(j=i+1;(j<deg) && used[j];j++);
+			if(j < deg)
+			{
+				used[j] = 1;
+				f[n][0] = creal(r[i])*creal(r[j]);
+				f[n][1] = -creal(r[i]) - creal(r[j]);
+				f[n++][2] = 1;
+			}
+			else
+			{
+				f[n][0] = -creal(r[i]);
+				f[n][1] = 1;
+				f[n++][2] = 0;
+			}
+		}
+	
+	/* low Q first so the resonant sections see band limited signal */
+	for(i=1;i<n;i++)
+		for(j=i;(j>0) && (f[j-1][1]*sqrt(f[j][0]*f[j][2]) <
+			f[j][1]*sqrt(f[j-1][0]*f[j-1][2]));j--)
+		{
+			memcpy(t, f[j], sizeof(t));
+			memcpy(f[j], f[j-1], sizeof(t));
+			memcpy(f[j-1], t, sizeof(t));
+		}
+	return n;
+}
+
+/*
+ * derive the sections of one netlist and write them as a table
+ */
+static int section(FILE *ofile, const char *fname, const char *name,
+	const char *var)
+{
+	netlist nl;
+	double complex d[MAXDEG+1], o[MAXDEG+1], vout = 0, w, r[MAXDEG];
+	double dc[MAXDEG+1], oc[MAXDEG+1], den[MAXSEC][3], num[MAXSEC][3];
+	double rg = 0, cg = 0, sc, g, k0;
+	int i, k, m, nr = 0, npt, ddeg, odeg, nden, nnum;
+	
+	if(parse(fname, &nl))
+		return 1;
+	
+	/* scale s near the RC corners so the coefficients stay comparable */
+	for(i=0;i<nl.nelem;i++)
+		if(nl.e[i].type == 'R')
+			rg += log(nl.e[i].val), nr++;
+		else if(nl.e[i].type == 'C')
+			cg += log(nl.e[i].val);
+	sc = exp(-rg/(nr ? nr : 1) - cg/(nl.ncap ? nl.ncap : 1));
+	
+	/* sample both polynomials on |s| = sc and transform */
+	npt = nl.ncap + 1;
+	for(k=0;k<npt;k++)
+	{
+		d[k] = solve(&nl, sc*cexp(2*M_PI*I*k/npt), &vout);
+		o[k] = d[k]*vout;
+	}
+	for(m=0;m<npt;m++)
+	{
+		for(dc[m]=oc[m]=0,k=0;k<npt;k++)
+		{
+			w = cexp(-2*M_PI*I*k*m/npt)/npt;
+			dc[m] += creal(d[k]*w);
+			oc[m] += creal(o[k]*w);
+		}
+	}
+	
+	/* drop coefficients that are only rounding */
+	ddeg = odeg = -1;
+	for(g=0,m=0;m<npt;m++)
+		g = fmax(g, fabs(dc[m]));
+	for(m=0;m<npt;m++)
+		if(fabs(dc[m]) > 1e-9*g)
+			ddeg = m;
+	for(g=0,m=0;m<npt;m++)
+		g = fmax(g, fabs(oc[m]));
+	for(m=0;m<npt;m++)
+		if(fabs(oc[m]) > 1e-9*g)
+			odeg = m;
+	if((ddeg < 1) || (odeg < 0) || (odeg > ddeg))
+	{
+		fprintf(stderr, "%s has no usable transfer function\n", fname);
+		return 1;
+	}
+	
+	/* factor, numerator factors go with the lowest Q sections */
+	roots(dc, ddeg, r);
+	nden = factor(r, ddeg, den);
+	roots(oc, odeg, r);
+	nnum = factor(r, odeg, num);
+	if(nnum > nden)
+	{
+		fprintf(stderr, "%s zeros don't fit its sections\n", fname);
+		return 1;
+	}
+	for(i=nnum;i<nden;i++)
+		num[i][0] = 1, num[i][1] = num[i][2] = 0;
+	
+	/* unity DC gain per section where possible, the rest in the first */
+	g = oc[odeg]/dc[ddeg];
+	for(i=0;i<nden;i++)
+	{
+		if((i > 0) && num[i][0] && den[i][0])
+		{
+			k0 = den[i][0]/num[i][0];
+			num[i][0] *= k0, num[i][1] *= k0, num[i][2] *= k0;
+			g /= k0;
+		}
+	}
+	num[0][0] *= g, num[0][1] *= g, num[0][2] *= g;
+	
+	/* a0 = 1 when there's no pole at DC */
+	for(i=0;i<nden;i++)
+		if((k0 = den[i][0]))
+			for(k=0;k<3;k++)
+				num[i][k] /= k0, den[i][k] /= k0;
+	
+	/* back from u = s/scale to s in rad/s */
+	fprintf(ofile, "\n/* %s, %d sections: b0 b1 b2 a0 a1 a2 in s */\n",
+		strrchr(fname, '/') ? strrchr(fname, '/') + 1 : fname, nden);
+	fprintf(ofile, "#define MV_%s_NSEC %d\n", name, nden);
+	fprintf(ofile, "static const double mv_%s_sos[%d][6] = {\n", var, nden);
+	for(i=0;i<nden;i++)
+		fprintf(ofile, "\t{%.10e, %.10e, %.10e, %.10e, %.10e, %.10e},\n",
+			num[i][0], num[i][1]/sc, num[i][2]/(sc*sc),
+			den[i][0], den[i][1]/sc, den[i][2]/(sc*sc));
+	fprintf(ofile, "};\n");
+	
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	char *aname = "../../spice/MV_AA_Filter.cir";
+	char *dname = "../../spice/MV_DAC_Filter.cir", *oname = "mv_afilt.h";
+	FILE *ofile;
+	
+	/* override defaults */
+	if(argc > 1)
+		aname = argv[1];
+	
+	if(argc > 2)
+		dname = argv[2];
+	
+	if(argc > 3)
+		oname = argv[3];
+	
+	/* open output file */
+	if(!(ofile = fopen(oname, "w")))
+	{
+		fprintf(stderr, "Couldn't open output file %s for write\n", oname);
+		exit(1);
+	}
+	
+	/* tack on the header */
+	fprintf(ofile, "/* mv_afilt.h - Midiverb I analog filter sections */\n");
+	fprintf(ofile, "/* generated by mk_mvfilt */\n");
+	
+	if(section(ofile, aname, "AA", "aa") ||
+		section(ofile, dname, "DAC", "dac"))
+	{
+		fclose(ofile);
+		exit(1);
+	}
+	
+	/* wrap up */
+	fclose(ofile);
+	exit(0);
+}
@@ -0,0 +1,191 @@
+/*
+ * mv_afe.c - Midiverb I emulator, analog input & output filters
+ * 10-17-26 E. Brombaugh
+ *
+ * Runs the s-domain sections made by mk_mvfilt from the SPICE netlists as
+ * a cascade of digital biquads. A recursive filter can't be split across
+ * lanes one sample per lane, so each section is instead unrolled over
+ * MV_AFE_N frames: the outputs of a step are the inputs times the section's
+ * impulse response plus the two state words times their zero input
+ * response, all precomputed. That is MV_AFE_N + 2 vector multiply-adds per
+ * step, and the state for the next step comes from the last two frames.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "mv_afe.h"
+
+typedef float mvfvec __attribute__((vector_size(4*MV_AFE_N)));
+
+/*
+ * set up a cascade of {b0 b1 b2 a0 a1 a2} sections in s, rate in half Hz.
+ * Returns 1 if there are too many sections.
+ */
+int mvafe_Init(mvafe *afe, const double (*sos)[6], int nsec, uint32_t rate2)
+{
+	double fs = rate2/2.0, w0, k, k2, b[3], a[3], y, s1, s2, x;
+	int i, j, n;
+	
+	if(nsec > MV_AFE_SECS)
+		return 1;
+	memset(afe, 0, sizeof(mvafe));
+	afe->nsec = nsec;
+	
+	for(i=0;i<nsec;i++)
+	{
+		/* bilinear, prewarped to the corner when it's below Nyquist */
+		w0 = sos[i][5] ? sqrt(sos[i][3]/sos[i][5]) : sos[i][3]/sos[i][4];
+		k = w0 < 0.9*M_PI*fs ? w0/tan(w0/(2*fs)) : 2*fs;
+		k2 = k*k;
+		if(!sos[i][2] && !sos[i][5])
+		{
+			/* first order, keep it out of the z = -1 pole */
+			b[0] = sos[i][1]*k + sos[i][0];
+			b[1] = sos[i][0] - sos[i][1]*k;
+			b[2] = 0;
+			a[0] = sos[i][4]*k + sos[i][3];
+			a[1] = sos[i][3] - sos[i][4]*k;
+			a[2] = 0;
+		}
+		else
+		{
+			b[0] = sos[i][2]*k2 + sos[i][1]*k + sos[i][0];
+			b[1] = 2*(sos[i][0] - sos[i][2]*k2);
+			b[2] = sos[i][2]*k2 - sos[i][1]*k + sos[i][0];
+			a[0] = sos[i][5]*k2 + sos[i][4]*k + sos[i][3];
+			a[1] = 2*(sos[i][3] - sos[i][5]*k2);
+			a[2] = sos[i][5]*k2 - sos[i][4]*k + sos[i][3];
+		}
+		for(j=0;j<3;j++)
+			b[j] /= a[0];
+		a[1] /= a[0];
+		a[2] /= a[0];
+		a[0] = 1;
+		for(j=0;j<3;j++)
+		{
+			afe->b[i][j] = b[j];
+			afe->a[i][j] = a[j];
+		}
+	
+		/* impulse response, shifted down one column per input frame */
+		for(s1=s2=0,n=0;n<MV_AFE_N;n++)
+		{
+			x = n ? 0 : 1;
+			y = b[0]*x + s1;
+			s1 = b[1]*x - a[1]*y + s2;
+			s2 = b[2]*x - a[2]*y;
+			for(j=0;j+n<MV_AFE_N;j++)
+				afe->hu[i][j][j+n] = y;
+		}
+	
+		/* zero input response of each state word */
+		for(j=0;j<2;j++)
+		{
+			for(s1=!j,s2=j,n=0;n<MV_AFE_N;n++)
+			{
+				y = s1;
+				s1 = -a[1]*y + s2;
+				s2 = -a[2]*y;
+				afe->hs[i][j][n] = y;
+			}
+		}
+	}
+	
+	return 0;
+}
+
+/*
+ * run one section over both channels in place, the two recursions are
+ * interleaved so each hides the other's latency
+ */
+static void mvafe_Section(mvafe *afe, int i, float x[2][MV_AFE_BLOCK],
+	size_t len)
+{
+	const float *b = afe->b[i], *a = afe->a[i];
+	mvfvec y, u, v, h;
+	float s1[2], s2[2], x0, x1, y0;
+	size_t n, k;
+	int j, ch;
+	
+	for(ch=0;ch<2;ch++)
+	{
+		s1[ch] = afe->st[ch][i][0];
+		s2[ch] = afe->st[ch][i][1];
+	}
+	
+	for(n=0;n+MV_AFE_N<=len;n+=MV_AFE_N)
+	{
+		for(ch=0;ch<2;ch++)
+		{
+			/* input part in two chains, it doesn't wait on the state */
+			u = v = (mvfvec){};
+			for(j=0;j<MV_AFE_N;j+=2)
+			{
+				memcpy(&h, afe->hu[i][j], sizeof(h));
+				u += h*x[ch][n+j];
+				memcpy(&h, afe->hu[i][j+1], sizeof(h));
+				v += h*x[ch][n+j+1];
+			}
+			memcpy(&h, afe->hs[i][0], sizeof(h));
+			y = u + v + h*s1[ch];
+			memcpy(&h, afe->hs[i][1], sizeof(h));
+			y += h*s2[ch];
+			
+			/* state after the last two frames */
+			x0 = x[ch][n+MV_AFE_N-2];
+			x1 = x[ch][n+MV_AFE_N-1];
+			s2[ch] = b[2]*x1 - a[2]*y[MV_AFE_N-1];
+			s1[ch] = b[1]*x1 - a[1]*y[MV_AFE_N-1] + b[2]*x0 -
+				a[2]*y[MV_AFE_N-2];
+			memcpy(&x[ch][n], &y, sizeof(y));
+		}
+	}
+	
+	for(ch=0;ch<2;ch++)
+	{
+		/* leftover frames one at a time */
+		for(k=n;k<len;k++)
+		{
+			y0 = b[0]*x[ch][k] + s1[ch];
+			s1[ch] = b[1]*x[ch][k] - a[1]*y0 + s2[ch];
+			s2[ch] = b[2]*x[ch][k] - a[2]*y0;
+			x[ch][k] = y0;
+		}
+		afe->st[ch][i][0] = s1[ch];
+		afe->st[ch][i][1] = s2[ch];
+	}
+}
+
+/*
+ * filter interleaved stereo frames, in and out may be the same
+ */
+void mvafe_Proc(mvafe *afe, const int16_t *in, int16_t *out, size_t frames)
+{
+	float x[2][MV_AFE_BLOCK];
+	size_t n, j;
+	int ch, i;
+	float y;
+	
+	while(frames)
+	{
+		n = frames < MV_AFE_BLOCK ? frames : MV_AFE_BLOCK;
+		for(j=0;j<n;j++)
+		{
+			x[0][j] = in[2*j];
+			x[1][j] = in[2*j+1];
+		}
+		for(i=0;i<afe->nsec;i++)
+			mvafe_Section(afe, i, x, n);
+		for(j=0;j<n;j++)
+			for(ch=0;ch<2;ch++)
+			{
+				/* kept free of libm calls so it vectorizes */
+				y = x[ch][j];
+				y = y > 32767.0f ? 32767.0f : (y < -32768.0f ? -32768.0f : y);
+				out[2*j+ch] = y + (y < 0 ? -0.5f : 0.5f);
+			}
+		in += 2*n;
+		out += 2*n;
+		frames -= n;
+	}
+}
@@ -0,0 +1,34 @@
+/*
+ * mv_afe.h - Midiverb I emulator, analog input & output filters
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_afe__
+#define __mv_afe__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* most sections in a cascade */
+#define MV_AFE_SECS 4
+
+/* frames per vector step, fixed so the layout doesn't depend on -march */
+#define MV_AFE_N 8
+
+/* frames converted to float at a time */
+#define MV_AFE_BLOCK 256
+
+typedef struct
+{
+	uint8_t nsec;						/* sections in the cascade */
+	float b[MV_AFE_SECS][3];			/* digital sections, a0 = 1 */
+	float a[MV_AFE_SECS][3];
+	float hu[MV_AFE_SECS][MV_AFE_N][MV_AFE_N];	/* input j to output k */
+	float hs[MV_AFE_SECS][2][MV_AFE_N];	/* state to output k */
+	float st[2][MV_AFE_SECS][2];		/* transposed DF II state per channel */
+} mvafe;
+
+int mvafe_Init(mvafe *afe, const double (*sos)[6], int nsec, uint32_t rate2);
+void mvafe_Proc(mvafe *afe, const int16_t *in, int16_t *out, size_t frames);
+
+#endif
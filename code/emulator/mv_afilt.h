@@ -0,0 +1,17 @@
+/* mv_afilt.h - Midiverb I analog filter sections */
+/* generated by mk_mvfilt */
+
+/* MV_AA_Filter.cir, 3 sections: b0 b1 b2 a0 a1 a2 in s */
+#define MV_AA_NSEC 3
+static const double mv_aa_sos[3][6] = {
+	{1.0000000000e+00, 0.0000000000e+00, 0.0000000000e+00, 1.0000000000e+00, 4.9830000000e-05, 1.6830000000e-09},
+	{1.0000000000e+00, 0.0000000000e+00, 0.0000000000e+00, 1.0000000000e+00, 6.6000000000e-06, 3.3000000000e-10},
+	{1.0000000000e+00, 0.0000000000e+00, 0.0000000000e+00, 1.0000000000e+00, 2.0680000000e-06, 2.2841060000e-10},
+};
+
+/* MV_DAC_Filter.cir, 2 sections: b0 b1 b2 a0 a1 a2 in s */
+#define MV_DAC_NSEC 2
+static const double mv_dac_sos[2][6] = {
+	{1.0000000000e+00, 0.0000000000e+00, 0.0000000000e+00, 1.0000000000e+00, 1.2982671459e-06, 0.0000000000e+00},
+	{1.0000000000e+00, 0.0000000000e+00, 0.0000000000e+00, 1.0000000000e+00, 2.2101732854e-05, 2.6445404637e-10},
+};
@@ -0,0 +1,209 @@
+/*
+ * mv_chain.c - Midiverb I emulator, signal chain from input to output
+ * 10-17-26 E. Brombaugh
+ *
+ * Everything between the host's input and output samples: the optional
+ * resampling to the hardware rate and analog filters around the program,
+ * and the switch that changes programs. It works MV_CHAIN_BLOCK frames at
+ * a time on the same boundaries however the input is cut up, so a file
+ * sounds the same from every tool and mode.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mv_chain.h"
+#include "mv_afilt.h"
+
+/*
+ * set up a chain at a host rate in Hz, spare may be NULL when the program
+ * never changes. Returns 1 if out of memory.
+ */
+int mvchain_Init(mvchain *c, uint32_t rate, int native, int analog,
+	mvblk *cur, mvblk *spare)
+{
+	uint32_t rate2 = native ? MV_RATE2 : 2*rate;
+	size_t n = MV_CHAIN_BLOCK, m = MV_CHAIN_BLOCK;
+	
+	c->native = native;
+	c->analog = analog;
+	c->nin = c->nout = c->obuf = NULL;
+	memset(&c->down, 0, sizeof(mvrs));
+	memset(&c->up, 0, sizeof(mvrs));
+	memset(c->zero, 0, sizeof(c->zero));
+	c->prog2 = -1;
+	c->half = 0;
+	c->taken = c->given = 0;
+	c->drop = 0;
+	mvswitch_Init(&c->sw, cur, spare, MV_CHAIN_WARM, MV_CHAIN_XFADE);
+	
+	/* host rate -> hardware rate -> host rate */
+	if(native)
+	{
+		if(mvrs_Init(&c->down, 2*rate, MV_RATE2) ||
+			mvrs_Init(&c->up, MV_RATE2, 2*rate))
+			return 1;
+		n = mvrs_MaxOut(&c->down, MV_CHAIN_BLOCK);
+		m = mvrs_MaxOut(&c->up, n);
+		
+		/* both filters' delay in host frames, so -n lines up with the input */
+		c->drop = lrint(mvrs_Delay(&c->down)*c->up.L/c->up.M +
+			mvrs_Delay(&c->up));
+		c->nin = malloc(2*n*sizeof(int16_t));
+		c->nout = malloc(2*n*sizeof(int16_t));
+		if(!c->nin || !c->nout)
+			return 1;
+	}
+	if(!(c->obuf = malloc(2*m*sizeof(int16_t))))
+		return 1;
+	
+	/* analog filters at the rate the program runs at */
+	if(analog)
+	{
+		mvafe_Init(&c->aa, mv_aa_sos, MV_AA_NSEC, rate2);
+		mvafe_Init(&c->dac, mv_dac_sos, MV_DAC_NSEC, rate2);
+	}
+	
+	return 0;
+}
+
+/*
+ * run frames of input, NULL for a block of silence once it has ended, and
+ * return the output frames. Never gives more frames than it has taken, and
+ * at most what fits in obuf for a call of up to MV_CHAIN_BLOCK frames.
+ */
+size_t mvchain_Proc(mvchain *c, const int16_t *in, size_t frames,
+	int16_t *out)
+{
+	const int16_t *pin;
+	int16_t *pout;
+	size_t total = 0, f, n, m, d;
+	
+	if(!in)
+	{
+		/* nothing held back at the host rate */
+		if(c->taken == c->given)
+			return 0;
+		frames = MV_CHAIN_BLOCK;
+	}
+	while(frames)
+	{
+		f = in ? MV_CHAIN_BLOCK - c->taken % MV_CHAIN_BLOCK : MV_CHAIN_BLOCK;
+		f = f < frames ? f : frames;
+		pin = in ? in : c->zero;
+	
+		/* change program like a control thread would */
+		if(in && (c->prog2 >= 0) && (c->taken < c->half) &&
+			(c->taken + (int64_t)f >= c->half))
+			mvswitch_Post(&c->sw, c->prog2);
+	
+		/* host rate goes straight to the output */
+		if(c->native)
+		{
+			n = mvrs_Proc(&c->down, pin, f, c->nin);
+			pin = c->nin;
+			pout = c->nout;
+		}
+		else
+		{
+			n = f;
+			pout = out;
+		}
+		if(c->analog)
+		{
+			/* the input may be a read only mapping */
+			mvafe_Proc(&c->aa, pin, c->native ? c->nin : c->abuf, n);
+			pin = c->native ? c->nin : c->abuf;
+		}
+		mvswitch_ProcBlock(&c->sw, pin, pout, n);
+		if(c->analog)
+			mvafe_Proc(&c->dac, pout, pout, n);
+		m = c->native ? mvrs_Proc(&c->up, c->nout, n, out) : f;
+		
+		/* the resampler delay comes off the front, flushed at the end */
+		if(c->drop && m)
+		{
+			d = m < c->drop ? m : c->drop;
+			memmove(out, &out[2*d], 2*(m - d)*sizeof(int16_t));
+			m -= d;
+			c->drop -= d;
+		}
+	
+		if(in)
+		{
+			c->taken += f;
+			in += 2*f;
+		}
+		if(m > (size_t)(c->taken - c->given))
+			m = c->taken - c->given;
+		c->given += m;
+		out += 2*m;
+		total += m;
+		frames -= f;
+	}
+	
+	return total;
+}
+
+/*
+ * run a whole mapping through the chain from frame start, input frames
+ * converted per block and the output written to the same frame of dst.
+ * 16 bit stereo at the host rate is used in place. Returns what step
+ * stopped it with, or 0.
+ */
+int mvchain_Render(mvchain *c, const mvpcm *src, const mvpcm *dst,
+	int32_t start, int32_t samples, mvchain_step step, void *ctx)
+{
+	int direct, inplace, err;
+	int32_t scnt, written, frames;
+	const int16_t *pin;
+	int16_t *pout;
+	size_t n;
+	
+	direct = (src->fmt == WAV_S16) && (src->chls == 2);
+	inplace = direct && !c->native && (dst->fmt == WAV_S16) &&
+		(dst->chls == 2);
+	for(scnt=written=start;written<samples;scnt+=frames)
+	{
+		/* a block of stereo samples, then silence flushes the resampler */
+		frames = samples-scnt < MV_CHAIN_BLOCK ? samples-scnt :
+			MV_CHAIN_BLOCK;
+		if(!frames)
+			pin = NULL;
+		else if(direct)
+			pin = (const int16_t *)&src->data[scnt*src->bytesmpl];
+		else
+		{
+			wav_to_s16(&src->data[scnt*src->bytesmpl], src->fmt, src->chls,
+				c->ibuf, frames);
+			pin = c->ibuf;
+		}
+	
+		if(inplace)
+			pout = (int16_t *)&dst->data[written*dst->bytesmpl];
+		else
+			pout = c->obuf;
+		n = mvchain_Proc(c, pin, frames, pout);
+		if(!inplace)
+			wav_from_s16(pout, dst->fmt, dst->chls,
+				&dst->data[written*dst->bytesmpl], n);
+		written += n;
+		
+		if(step && (err = step(ctx, c)))
+			return err;
+	}
+	
+	return 0;
+}
+
+/*
+ * release what mvchain_Init() allocated, also after it failed
+ */
+void mvchain_Free(mvchain *c)
+{
+	free(c->obuf);
+	free(c->nout);
+	free(c->nin);
+	mvrs_Free(&c->up);
+	mvrs_Free(&c->down);
+}
@@ -0,0 +1,60 @@
+/*
+ * mv_chain.h - Midiverb I emulator, signal chain from input to output
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_chain__
+#define __mv_chain__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midiverb.h"
+#include "mv_switch.h"
+#include "mv_resamp.h"
+#include "mv_afe.h"
+#include "wav_conv.h"
+
+/* frames processed per call to the emulator */
+#define MV_CHAIN_BLOCK 256
+
+/* program change timing, frames */
+#define MV_CHAIN_WARM 8192
+#define MV_CHAIN_XFADE 2048
+
+typedef struct
+{
+	int native, analog;				/* hardware rate, analog filters */
+	mvswitch sw;
+	mvrs down, up;
+	mvafe aa, dac;
+	int16_t *nin, *nout;			/* hardware rate blocks */
+	int16_t *obuf;					/* output of one MV_CHAIN_BLOCK call */
+	int16_t ibuf[2*MV_CHAIN_BLOCK];	/* input converted to 16 bit stereo */
+	int16_t abuf[2*MV_CHAIN_BLOCK];	/* filtered input at the host rate */
+	int16_t zero[2*MV_CHAIN_BLOCK];	/* silence to flush the resampler */
+	int prog2;						/* program to change to, -1 for none */
+	int64_t half;					/* input frame it changes at */
+	int64_t taken, given;			/* frames in and out */
+	size_t drop;					/* resampler delay left to drop */
+} mvchain;
+
+/* mapped frames in one of the wav_conv.h formats */
+typedef struct
+{
+	uint8_t *data;
+	int fmt;
+	uint16_t chls, bytesmpl;
+} mvpcm;
+
+/* called after each block, a nonzero return stops the render */
+typedef int (*mvchain_step)(void *ctx, mvchain *c);
+
+int mvchain_Init(mvchain *c, uint32_t rate, int native, int analog,
+	mvblk *cur, mvblk *spare);
+size_t mvchain_Proc(mvchain *c, const int16_t *in, size_t frames,
+	int16_t *out);
+int mvchain_Render(mvchain *c, const mvpcm *src, const mvpcm *dst,
+	int32_t start, int32_t samples, mvchain_step step, void *ctx);
+void mvchain_Free(mvchain *c);
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * mv_jit.c - Midiverb I emulator, runtime x86-64 code generation
+ * 10-17-26 E. Brombaugh
+ *
+ * Translates a 128-word program into native code with acc in eax, asum
+ * in r8d and the DRAM base in r9. Generated function is
+ *   void fn(mvblk *blk, const int16_t *in, int16_t *out, size_t frames)
+ * (SysV: rdi, rsi, rdx, rcx). r10d holds the AI bus, r11d is scratch.
+ */
+
+#include <string.h>
+#include "mv_jit.h"
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+/* size of executable buffer */
+#define JIT_SIZE 65536
+
+/* worst case bytes emitted per instruction */
+#define JIT_MAXINSTR 64
+
+/* per-instruction code generation flags */
+#define J_NOACC 1					/* acc result never used */
+#define J_NOWR 2					/* write overwritten before read */
+#define J_NOP 4						/* folded into next instruction */
+#define J_UNITY 8					/* second half of a unity read */
+
+/* append bytes to the code buffer */
+#define EMIT(j, ...) mvjit_Emit(j, (const uint8_t []){__VA_ARGS__}, \
+	sizeof((const uint8_t []){__VA_ARGS__}))
+
+static void mvjit_Emit(mvjit *jit, const uint8_t *b, size_t n)
+{
+	memcpy(&jit->code[jit->len], b, n);
+	jit->len += n;
+}
+
+static void mvjit_Emit32(mvjit *jit, uint32_t x)
+{
+	memcpy(&jit->code[jit->len], &x, 4);
+	jit->len += 4;
+}
+
+/*
+ * Work out which parts of each instruction can be dropped
+ */
+static void mvjit_Analyze(const uint16_t *ucode, uint16_t optbits,
+	uint8_t *flags)
+{
+	uint8_t op[128], i, j, live, live0, dac;
+	uint16_t off[128], asum = 0;
+	
+	for(i=0;i<128;i++)
+	{
+		op[i] = (ucode[i] >> 14) & 0x3;
+		off[i] = asum;
+		asum = (asum + ucode[i])&0x3fff;
+		flags[i] = 0;
+	}
+	
+	if(optbits & 5)
+	{
+		/*--------------------------------------------------------------*/
+		/* acc liveness, wrapping from the end of one sample to the     */
+		/* start of the next, iterated until the sample entry settles   */
+		/*--------------------------------------------------------------*/
+		live0 = 0;
+		while(1)
+		{
+			live = live0;
+			i = 128;
+			while(i--)
+			{
+				dac = (i==0x60) || (i==0x70);
+				if(!dac)
+				{
+					flags[i] = live ? 0 : J_NOACC;
+					live = live && !(op[i]&1);
+				}
+				
+				/* AI from acc */
+				if(i && (op[i]&2))
+					live = 1;
+			}
+			
+			if(live == live0)
+				break;
+			live0 = live;
+		}
+	}
+	
+	/*------------------------------------------------------------------*/
+	/* unity acc/clear reads - same DRAM word read twice in a row adds  */
+	/* 2*((m>>1) + sgn) = (m & ~1) + 2*sgn with a single load           */
+	/*------------------------------------------------------------------*/
+	for(i=2;i<128;i++)
+	{
+		j = i-1;
+		if((i==0x60) || (i==0x70) || (j==0x60) || (j==0x70))
+			continue;
+		if((op[i] != 0) || (op[j] & 2) || (off[i] != off[j]))
+			continue;
+		if(flags[i] || flags[j])
+			continue;
+		if(!(optbits & ((op[j]&1) ? 32 : 16)))
+			continue;
+		flags[j] |= J_NOP;
+		flags[i] |= J_UNITY;
+	}
+	
+	if(optbits & 64)
+	{
+		/*--------------------------------------------------------------*/
+		/* remove writes overwritten later in the sample before a read  */
+		/*--------------------------------------------------------------*/
+		for(i=0;i<127;i++)
+		{
+			if(i && !(op[i]&2))
+				continue;
+			for(j=i+1;j<128;j++)
+			{
+				if(off[j] != off[i])
+					continue;
+				if(op[j]&2)
+					flags[i] |= J_NOWR;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Set up the executable buffer
+ */
+int mvjit_Init(mvjit *jit)
+{
+	jit->fn = NULL;
+	jit->len = 0;
+	jit->size = 0;
+	jit->code = NULL;
+	
+#if defined(__x86_64__)
+	jit->code = mmap(NULL, JIT_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(jit->code == MAP_FAILED)
+	{
+		jit->code = NULL;
+		return 1;
+	}
+	jit->size = JIT_SIZE;
+	return 0;
+#else
+	return 1;
+#endif
+}
+
+/*
+ * Generate native code for one program
+ */
+int mvjit_Compile(mvjit *jit, const uint16_t *ucode, uint16_t optbits)
+{
+#if defined(__x86_64__)
+	uint8_t flags[128], op, i, sib;
+	uint16_t asum = 0, off;
+	size_t loop, done;
+	int32_t rel;
+	
+	if(!jit->code)
+		return 1;
+	
+	mvjit_Analyze(ucode, optbits, flags);
+	
+	/* writable while we emit */
+	jit->fn = NULL;
+	if(mprotect(jit->code, jit->size, PROT_READ | PROT_WRITE))
+		return 1;
+	jit->len = 0;
+	
+	/* test rcx,rcx ; jz done */
+	EMIT(jit, 0x48, 0x85, 0xC9);
+	EMIT(jit, 0x0F, 0x84);
+	done = jit->len;
+	mvjit_Emit32(jit, 0);
+	
+	/* movsx eax,[rdi+acc] ; movzx r8d,[rdi+asum] ; lea r9,[rdi+dram] */
+	EMIT(jit, 0x0F, 0xBF, 0x87);
+	mvjit_Emit32(jit, offsetof(mvblk, acc));
+	EMIT(jit, 0x44, 0x0F, 0xB7, 0x87);
+	mvjit_Emit32(jit, offsetof(mvblk, asum));
+	EMIT(jit, 0x4C, 0x8D, 0x8F);
+	mvjit_Emit32(jit, offsetof(mvblk, dram));
+	
+	loop = jit->len;
+	for(i=0;i<128;i++)
+	{
+		op = (ucode[i] >> 14) & 0x3;
+		off = asum;
+		asum = (asum + ucode[i])&0x3fff;
+		
+		if(jit->len + JIT_MAXINSTR > jit->size)
+			return 1;
+		
+		/* reads feeding a dead acc do nothing at all */
+		if((flags[i] & J_NOP) || (i && !(op&2) && (flags[i] & J_NOACC) &&
+			(i!=0x60) && (i!=0x70)))
+			continue;
+		
+		/* DRAM word is [r9 + r8*2] at the sample base, else r11 */
+		if(off)
+		{
+			/* lea r11d,[r8+off] ; and r11d,0x3fff */
+			EMIT(jit, 0x45, 0x8D, 0x98);
+			mvjit_Emit32(jit, off);
+			EMIT(jit, 0x41, 0x81, 0xE3, 0xFF, 0x3F, 0x00, 0x00);
+			sib = 0x59;
+		}
+		else
+			sib = 0x41;
+		
+		/* Drive AI bus into r10d */
+		if(i==0)
+		{
+			/* movsx r10d,[rsi] ; movsx r11d,[rsi+2] ; sar both 4 */
+			EMIT(jit, 0x44, 0x0F, 0xBF, 0x16);
+			EMIT(jit, 0x44, 0x0F, 0xBF, 0x5E, 0x02);
+			EMIT(jit, 0x41, 0xC1, 0xFA, 0x04);
+			EMIT(jit, 0x41, 0xC1, 0xFB, 0x04);
+			
+			/* add r10d,r11d ; and r10d,0xfffe ; movsx r10d,r10w */
+			EMIT(jit, 0x45, 0x01, 0xDA);
+			EMIT(jit, 0x41, 0x81, 0xE2, 0xFE, 0xFF, 0x00, 0x00);
+			EMIT(jit, 0x45, 0x0F, 0xBF, 0xD2);
+		}
+		else if(op&2)
+		{
+			/* movsx r10d,ax ; (not r10d) */
+			EMIT(jit, 0x44, 0x0F, 0xBF, 0xD0);
+			if(op&1)
+				EMIT(jit, 0x41, 0xF7, 0xD2);
+		}
+		else
+		{
+			/* movsx r10d,[r9+idx*2] */
+			EMIT(jit, 0x47, 0x0F, 0xBF, 0x14, sib);
+		}
+		
+		/* DRAM write - mov [r9+idx*2],r10w */
+		if(((op&2) || (i==0)) && !(flags[i] & J_NOWR))
+			EMIT(jit, 0x66, 0x47, 0x89, 0x14, sib);
+		
+		if((i==0x60) || (i==0x70))
+		{
+			/* clamp r10d to -4096..4095 with cmov */
+			EMIT(jit, 0x41, 0xBB, 0xFF, 0x0F, 0x00, 0x00);
+			EMIT(jit, 0x45, 0x39, 0xDA);
+			EMIT(jit, 0x45, 0x0F, 0x4F, 0xD3);
+			EMIT(jit, 0x41, 0xBB, 0x00, 0xF0, 0xFF, 0xFF);
+			EMIT(jit, 0x45, 0x39, 0xDA);
+			EMIT(jit, 0x45, 0x0F, 0x4C, 0xD3);
+			
+			/* shl r10d,3 ; mov [rdx+ch],r10w - 0x60 is right */
+			EMIT(jit, 0x41, 0xC1, 0xE2, 0x03);
+			EMIT(jit, 0x66, 0x44, 0x89, 0x52, (i==0x60) ? 2 : 0);
+			continue;
+		}
+		
+		if(flags[i] & J_NOACC)
+			continue;
+		
+		if(flags[i] & J_UNITY)
+		{
+			/* r11d = (ai & ~1) + 2*sgn, i.e. both halves at once */
+			EMIT(jit, 0x45, 0x89, 0xD3);
+			EMIT(jit, 0x41, 0x83, 0xE3, 0xFE);
+			EMIT(jit, 0x41, 0xC1, 0xEA, 0x1F);
+			EMIT(jit, 0x47, 0x8D, 0x1C, 0x53);
+			
+			/* first half decides keep vs clear */
+			op = (ucode[i-1] >> 14) & 0x3;
+		}
+		else
+		{
+			/* r11d = (ai >> 1) + sgn */
+			EMIT(jit, 0x45, 0x89, 0xD3);
+			EMIT(jit, 0x41, 0xD1, 0xFB);
+			EMIT(jit, 0x41, 0xC1, 0xEA, 0x1F);
+			EMIT(jit, 0x45, 0x01, 0xD3);
+		}
+		
+		/* add eax,r11d or mov eax,r11d */
+		if(op&1)
+			EMIT(jit, 0x44, 0x89, 0xD8);
+		else
+			EMIT(jit, 0x44, 0x01, 0xD8);
+	}
+	
+	/* next frame: add rsi,4 ; add rdx,4 ; advance & wrap asum */
+	EMIT(jit, 0x48, 0x83, 0xC6, 0x04);
+	EMIT(jit, 0x48, 0x83, 0xC2, 0x04);
+	EMIT(jit, 0x41, 0x81, 0xC0);
+	mvjit_Emit32(jit, asum);
+	EMIT(jit, 0x41, 0x81, 0xE0, 0xFF, 0x3F, 0x00, 0x00);
+	
+	/* dec rcx ; jnz loop */
+	EMIT(jit, 0x48, 0xFF, 0xC9);
+	EMIT(jit, 0x0F, 0x85);
+	rel = loop - (jit->len + 4);
+	mvjit_Emit32(jit, rel);
+	
+	/* done: save acc & asum, return */
+	rel = jit->len - (done + 4);
+	memcpy(&jit->code[done], &rel, 4);
+	EMIT(jit, 0x66, 0x89, 0x87);
+	mvjit_Emit32(jit, offsetof(mvblk, acc));
+	EMIT(jit, 0x66, 0x44, 0x89, 0x87);
+	mvjit_Emit32(jit, offsetof(mvblk, asum));
+	EMIT(jit, 0xC3);
+	
+	/* executable from here on */
+	if(mprotect(jit->code, jit->size, PROT_READ | PROT_EXEC))
+		return 1;
+	jit->fn = (void (*)(mvblk *, const int16_t *, int16_t *, size_t))jit->code;
+	return 0;
+#else
+	return 1;
+#endif
+}
+
+/*
+ * process a block of interleaved stereo frames with the compiled program.
+ * The code addresses a full 16384-word DRAM and is only the microcode it
+ * was compiled from, so an instance with a short ring gets silence and a
+ * return of 1 like a failed compile, rather than blk->prog.
+ */
+int mvjit_ProcBlock(mvjit *jit, mvblk *blk, const int16_t *in,
+	int16_t *out, size_t frames)
+{
+	if(!jit->fn || (blk->mask != 0x3fff))
+	{
+		memset(out, 0, frames*2*sizeof(int16_t));
+		return 1;
+	}
+	
+	/* idle tracking starts over */
+	midiverb_Wake(blk);
+	blk->nexec += frames;
+	jit->fn(blk, in, out, frames);
+	return 0;
+}
+
+/*
+ * release the executable buffer
+ */
+void mvjit_Free(mvjit *jit)
+{
+#if defined(__x86_64__)
+	if(jit->code)
+		munmap(jit->code, jit->size);
+#endif
+	jit->code = NULL;
+	jit->fn = NULL;
+}
@@ -0,0 +1,37 @@
+/*
+ * mv_jit.h - Midiverb I emulator, runtime x86-64 code generation
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_jit__
+#define __mv_jit__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midiverb.h"
+
+/*
+ * optimization bits, same numbering as mv_gencode -O. Only the rules that
+ * keep DRAM & outputs bit-exact are applied:
+ *   1, 4 - remove acc ops whose result is never used
+ *  16,32 - collapse unity acc/clear reads into one load
+ *     64 - remove writes overwritten before they're read
+ * 2 (output relocation) and 8 (approximate math) are ignored.
+ */
+#define MV_JIT_OPT 0x75
+
+typedef struct
+{
+	uint8_t *code;					/* executable buffer */
+	size_t size;					/* buffer size */
+	size_t len;						/* bytes emitted */
+	void (*fn)(mvblk *, const int16_t *, int16_t *, size_t);
+} mvjit;
+
+int mvjit_Init(mvjit *jit);
+int mvjit_Compile(mvjit *jit, const uint16_t *ucode, uint16_t optbits);
+int mvjit_ProcBlock(mvjit *jit, mvblk *blk, const int16_t *in,
+	int16_t *out, size_t frames);
+void mvjit_Free(mvjit *jit);
+
+#endif
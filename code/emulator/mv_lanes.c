@@ -0,0 +1,140 @@
+/*
+ * mv_lanes.c - Midiverb I emulator, N instances of one program in lockstep
+ * 10-17-26 E. Brombaugh
+ *
+ * The DRAM address sequence only depends on the microcode, so every
+ * instance running the same program touches the same address on every
+ * instruction. With DRAM stored [addr][lane] each access becomes one
+ * contiguous vector load or store across all instances.
+ */
+
+#include <string.h>
+#include "mv_lanes.h"
+
+#include "mv_simd.h"
+
+#if MV_LANES != MV_VLEN
+#error "lane count must match the vector width"
+#endif
+
+/*
+ * Initialize a group of Midiverb entities
+ */
+void mvlanes_Init(mvlanes *blk)
+{
+	blk->prog = 255;
+	blk->asum = 0;
+	memset(blk->acc, 0, sizeof(blk->acc));
+	memset(blk->dram, 0, sizeof(blk->dram));
+}
+
+/*
+ * Set program for all lanes
+ */
+void mvlanes_SetProg(mvlanes *blk, uint8_t prog)
+{
+	blk->prog = prog;
+	if(prog <= 62)
+		midiverb_Decode(&blk->dec, midiverb_Ucode(prog));
+}
+
+/*
+ * AI bus & DRAM write for one instruction on all lanes
+ */
+static inline mvvec mvlanes_Ai(const mvdec *dec, int16_t *p, uint8_t i,
+	mvvec acc)
+{
+	mvvec ai;
+	
+	if(dec->rd[i])
+		ai = v_load(p);
+	else
+		ai = v_xor(acc, v_set1(dec->inv[i]));
+	
+	if(dec->wr[i])
+		v_store(p, ai);
+	
+	return ai;
+}
+
+/*
+ * run instructions [start, end) on all lanes
+ */
+static inline mvvec mvlanes_Seg(mvlanes *blk, uint8_t start, uint8_t end,
+	mvvec acc, uint16_t asum)
+{
+	const mvdec *dec = &blk->dec;
+	mvvec ai;
+	uint8_t i;
+	
+	for(i=start;i<end;i++)
+	{
+		ai = mvlanes_Ai(dec, blk->dram[(asum + dec->off[i])&0x3fff], i, acc);
+		acc = v_acc(ai, acc, dec->keep[i]);
+	}
+	
+	return acc;
+}
+
+/*
+ * DAC slot on all lanes, saturate & scale into one output channel
+ */
+static inline void mvlanes_Dac(mvlanes *blk, uint8_t i, mvvec acc,
+	uint16_t asum, int16_t *out)
+{
+	int16_t tmp[MV_LANES];
+	mvvec ai;
+	uint8_t l;
+	
+	ai = mvlanes_Ai(&blk->dec, blk->dram[(asum + blk->dec.off[i])&0x3fff],
+		i, acc);
+	ai = v_dac(ai);
+	v_store(tmp, ai);
+	for(l=0;l<MV_LANES;l++)
+		out[2*l] = tmp[l];
+}
+
+/*
+ * process a block of frames, in/out are [frame][lane][L/R]
+ */
+void mvlanes_ProcBlock(mvlanes *blk, const int16_t *in, int16_t *out,
+	size_t frames)
+{
+	int16_t tmp[MV_LANES];
+	uint16_t asum = blk->asum;
+	mvvec acc, ai;
+	uint8_t l;
+	
+	/* don't try to execute illegal programs */
+	if(blk->prog > 62)
+	{
+		memset(out, 0, frames*2*MV_LANES*sizeof(int16_t));
+		return;
+	}
+	
+	acc = v_load(blk->acc);
+	
+	while(frames--)
+	{
+		/* ADC slot - scale and mix each lane's input */
+		for(l=0;l<MV_LANES;l++)
+			tmp[l] = ((in[2*l]>>4) + (in[2*l+1]>>4)) & 0xFFFE;
+		ai = v_load(tmp);
+		v_store(blk->dram[asum], ai);
+		acc = v_acc(ai, acc, blk->dec.keep[0]);
+		
+		/* DAC slots split the rest into three runs */
+		acc = mvlanes_Seg(blk, 0x01, 0x60, acc, asum);
+		mvlanes_Dac(blk, 0x60, acc, asum, &out[1]);
+		acc = mvlanes_Seg(blk, 0x61, 0x70, acc, asum);
+		mvlanes_Dac(blk, 0x70, acc, asum, &out[0]);
+		acc = mvlanes_Seg(blk, 0x71, 0x80, acc, asum);
+		
+		asum = (asum + blk->dec.sum)&0x3fff;
+		in += 2*MV_LANES;
+		out += 2*MV_LANES;
+	}
+	
+	v_store(blk->acc, acc);
+	blk->asum = asum;
+}
@@ -0,0 +1,34 @@
+/*
+ * mv_lanes.h - Midiverb I emulator, N instances of one program in lockstep
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_lanes__
+#define __mv_lanes__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midiverb.h"
+
+/* instances per group - one per 16-bit vector lane */
+#if defined(__AVX2__)
+#define MV_LANES 16
+#else
+#define MV_LANES 8
+#endif
+
+typedef struct
+{
+	uint8_t prog;					/* program index */
+	uint16_t asum;					/* Address Gen, shared by all lanes */
+	mvdec dec;						/* decoded program */
+	int16_t acc[MV_LANES];			/* per-lane accumulators */
+	int16_t dram[16384][MV_LANES];	/* lane-interleaved DRAM */
+} mvlanes;
+
+void mvlanes_Init(mvlanes *blk);
+void mvlanes_SetProg(mvlanes *blk, uint8_t prog);
+void mvlanes_ProcBlock(mvlanes *blk, const int16_t *in, int16_t *out,
+	size_t frames);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * mv_pipe.c - Midiverb I emulator, reader / DSP / writer pipeline
+ * 10-17-26 E. Brombaugh
+ *
+ * The reader and writer each get a thread and the DSP runs on the caller's,
+ * joined by two single producer, single consumer rings of fixed blocks. A
+ * stage only touches the ring's counters with acquire / release atomics, so
+ * nothing locks. A full ring holds its producer back and an empty one its
+ * consumer, which spin briefly and then sleep, so the slowest stage sets
+ * the pace without unbounded buffering.
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "mv_pipe.h"
+
+/* waits before a stage yields, then sleeps */
+#define SPINS 64
+#define YIELDS 256
+
+typedef struct
+{
+	int16_t *buf;					/* MV_PIPE_DEPTH blocks of stride */
+	size_t stride;					/* samples per block */
+	size_t len[MV_PIPE_DEPTH];		/* frames in each, 0 ends the stream */
+	atomic_uint head;				/* blocks published by the producer */
+	atomic_uint tail;				/* blocks released by the consumer */
+} mvring;
+
+typedef struct
+{
+	mvring in, out;
+	mvpipe_rd rd;
+	mvpipe_wr wr;
+	void *rctx, *wctx;
+	atomic_int abort;				/* a stage failed, the others give up */
+} mvpipe;
+
+/*
+ * back off while another stage catches up
+ */
+static void mvpipe_Wait(unsigned *n)
+{
+	struct timespec ts = {0, 50000};
+	
+	if(++*n < SPINS)
+		return;
+	if(*n < YIELDS)
+		sched_yield();
+	else
+		nanosleep(&ts, NULL);
+}
+
+/*
+ * producer's next free block, NULL if the pipe was aborted
+ */
+static int16_t *mvring_Claim(mvpipe *p, mvring *r)
+{
+	unsigned n = 0, head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	
+	while(head - atomic_load_explicit(&r->tail, memory_order_acquire) ==
+		MV_PIPE_DEPTH)
+	{
+		if(atomic_load_explicit(&p->abort, memory_order_relaxed))
+			return NULL;
+		mvpipe_Wait(&n);
+	}
+	return &r->buf[(head & (MV_PIPE_DEPTH-1))*r->stride];
+}
+
+/*
+ * hand the claimed block to the consumer
+ */
+static void mvring_Publish(mvring *r, size_t len)
+{
+	unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	
+	r->len[head & (MV_PIPE_DEPTH-1)] = len;
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+/*
+ * consumer's next full block, NULL if the pipe was aborted
+ */
+static int16_t *mvring_Peek(mvpipe *p, mvring *r, size_t *len)
+{
+	unsigned n = 0, tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	
+	while(atomic_load_explicit(&r->head, memory_order_acquire) == tail)
+	{
+		if(atomic_load_explicit(&p->abort, memory_order_relaxed))
+			return NULL;
+		mvpipe_Wait(&n);
+	}
+	*len = r->len[tail & (MV_PIPE_DEPTH-1)];
+	return &r->buf[(tail & (MV_PIPE_DEPTH-1))*r->stride];
+}
+
+/*
+ * give a consumed block back to the producer
+ */
+static void mvring_Release(mvring *r)
+{
+	unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+/*
+ * reader stage, ends the stream with an empty block
+ */
+static void *mvpipe_Reader(void *arg)
+{
+	mvpipe *p = arg;
+	int16_t *b;
+	size_t n;
+	
+	do
+	{
+		if(!(b = mvring_Claim(p, &p->in)))
+			break;
+		n = p->rd(p->rctx, b, MV_PIPE_BLOCK);
+		mvring_Publish(&p->in, n);
+	}
+	while(n);
+	
+	return NULL;
+}
+
+/*
+ * writer stage
+ */
+static void *mvpipe_Writer(void *arg)
+{
+	mvpipe *p = arg;
+	int16_t *b;
+	size_t n;
+	
+	while((b = mvring_Peek(p, &p->out, &n)) && n)
+	{
+		if(p->wr(p->wctx, b, n))
+		{
+			atomic_store(&p->abort, 1);
+			break;
+		}
+		mvring_Release(&p->out);
+	}
+	
+	return NULL;
+}
+
+/*
+ * run a stream through the three stages until the reader runs dry,
+ * returns 1 if a stage failed
+ */
+int mvpipe_Run(mvpipe_rd rd, void *rctx, mvpipe_dsp dsp, void *dctx,
+	mvpipe_wr wr, void *wctx)
+{
+	mvpipe p = {.rd = rd, .rctx = rctx, .wr = wr, .wctx = wctx};
+	pthread_t rt, wt;
+	int16_t *ib, *ob;
+	size_t n, m;
+	int err;
+	
+	p.in.stride = 2*MV_PIPE_BLOCK;
+	p.out.stride = 2*MV_PIPE_OUTMAX;
+	p.in.buf = malloc(MV_PIPE_DEPTH*p.in.stride*sizeof(int16_t));
+	p.out.buf = malloc(MV_PIPE_DEPTH*p.out.stride*sizeof(int16_t));
+	atomic_init(&p.in.head, 0);
+	atomic_init(&p.in.tail, 0);
+	atomic_init(&p.out.head, 0);
+	atomic_init(&p.out.tail, 0);
+	atomic_init(&p.abort, 0);
+	if(!p.in.buf || !p.out.buf)
+	{
+		free(p.in.buf);
+		free(p.out.buf);
+		return 1;
+	}
+	
+	if(pthread_create(&rt, NULL, mvpipe_Reader, &p))
+	{
+		free(p.in.buf);
+		free(p.out.buf);
+		return 1;
+	}
+	if(pthread_create(&wt, NULL, mvpipe_Writer, &p))
+	{
+		atomic_store(&p.abort, 1);
+		pthread_join(rt, NULL);
+		free(p.in.buf);
+		free(p.out.buf);
+		return 1;
+	}
+	
+	/* DSP stage, flushing its latency once the input ends */
+	while((ib = mvring_Peek(&p, &p.in, &n)))
+	{
+		do
+		{
+			if(!(ob = mvring_Claim(&p, &p.out)))
+				break;
+			m = dsp(dctx, n ? ib : NULL, n, ob);
+			if(m || !n)
+				mvring_Publish(&p.out, m);
+		}
+		while(!n && m);
+		mvring_Release(&p.in);
+		if(!n || !ob)
+			break;
+	}
+	
+	pthread_join(wt, NULL);
+	err = atomic_load(&p.abort);
+	atomic_store(&p.abort, 1);
+	pthread_join(rt, NULL);
+	free(p.in.buf);
+	free(p.out.buf);
+	
+	return err;
+}
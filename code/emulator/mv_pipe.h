@@ -0,0 +1,37 @@
+/*
+ * mv_pipe.h - Midiverb I emulator, reader / DSP / writer pipeline
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_pipe__
+#define __mv_pipe__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* stereo frames per block handed from the reader to the DSP */
+#define MV_PIPE_BLOCK 1024
+
+/* most frames the DSP may return for one block */
+#define MV_PIPE_OUTMAX (2*MV_PIPE_BLOCK)
+
+/* blocks in flight between two stages, power of two */
+#define MV_PIPE_DEPTH 8
+
+/* fill buf with up to frames, 0 at the end of the stream */
+typedef size_t (*mvpipe_rd)(void *ctx, int16_t *buf, size_t frames);
+
+/*
+ * process a block, in may be changed in place. Called with no input at the
+ * end of the stream until it returns 0 so latency can be flushed.
+ */
+typedef size_t (*mvpipe_dsp)(void *ctx, int16_t *in, size_t frames,
+	int16_t *out);
+
+/* consume a block, returns 1 on error */
+typedef int (*mvpipe_wr)(void *ctx, const int16_t *buf, size_t frames);
+
+int mvpipe_Run(mvpipe_rd rd, void *rctx, mvpipe_dsp dsp, void *dctx,
+	mvpipe_wr wr, void *wctx);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ * mv_pool.c - Midiverb I emulator, work-stealing thread pool
+ * 10-17-26 E. Brombaugh
+ *
+ * Jobs are dealt round robin to one deque per worker before any start, in
+ * the caller's order, so sorting the longest first spreads the big ones.
+ * A worker runs its own jobs in that order from the bottom of its deque
+ * and, once it is empty, steals the last ones from the top of the others.
+ * No jobs are pushed after the start, so the deques are fixed arrays and
+ * only the two ends move, with the Chase-Lev protocol: the owner and a
+ * thief racing for the last job settle it with one compare-exchange.
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "mv_pool.h"
+
+typedef struct
+{
+	int *job;						/* job numbers, last one runs first */
+	atomic_long top;				/* next to steal */
+	atomic_long bottom;				/* one past the owner's next */
+} mvdeque;
+
+typedef struct
+{
+	mvdeque *dq;
+	int threads;
+	mvpool_job fn;
+	void *ctx;
+} mvpool;
+
+typedef struct
+{
+	mvpool *pool;
+	int worker;
+} mvworker;
+
+/*
+ * owner takes from the bottom, -1 when empty
+ */
+static int mvdeque_Take(mvdeque *d)
+{
+	long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1, t;
+	int job = -1;
+	
+	atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&d->top, memory_order_relaxed);
+	if(t <= b)
+	{
+		job = d->job[b];
+		if(t == b)
+		{
+			/* last one, a thief may be after it too */
+			if(!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+				memory_order_seq_cst, memory_order_relaxed))
+				job = -1;
+			atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+		}
+	}
+	else
+		atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+	
+	return job;
+}
+
+/*
+ * thief takes from the top, -1 when empty or beaten to it
+ */
+static int mvdeque_Steal(mvdeque *d, int *empty)
+{
+	long t = atomic_load_explicit(&d->top, memory_order_acquire), b;
+	
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+	*empty = t >= b;
+	if(*empty)
+		return -1;
+	if(!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+		memory_order_seq_cst, memory_order_relaxed))
+		return -1;
+	
+	return d->job[t];
+}
+
+/*
+ * worker thread, its own jobs then everyone else's
+ */
+static void *mvpool_Worker(void *arg)
+{
+	mvworker *w = arg;
+	mvpool *p = w->pool;
+	int job, i, v, empty, busy;
+	
+	for(;;)
+	{
+		while((job = mvdeque_Take(&p->dq[w->worker])) >= 0)
+			p->fn(p->ctx, w->worker, job);
+	
+		/* nothing is added later, so once all are empty it's done */
+		for(busy=0,i=1;i<p->threads;i++)
+		{
+			v = (w->worker + i) % p->threads;
+			if((job = mvdeque_Steal(&p->dq[v], &empty)) >= 0)
+				break;
+			busy |= !empty;
+		}
+		if(job >= 0)
+			p->fn(p->ctx, w->worker, job);
+		else if(!busy)
+			break;
+	}
+	
+	return NULL;
+}
+
+/*
+ * run jobs 0 .. jobs-1 on up to threads workers, returns 1 if out of
+ * memory
+ */
+int mvpool_Run(int threads, int jobs, mvpool_job fn, void *ctx)
+{
+	mvpool p = {.threads = threads, .fn = fn, .ctx = ctx};
+	mvworker *w;
+	pthread_t *tid;
+	int i, n, err = 0;
+	
+	p.dq = calloc(threads, sizeof(mvdeque));
+	w = calloc(threads, sizeof(mvworker));
+	tid = calloc(threads, sizeof(pthread_t));
+	if(!p.dq || !w || !tid)
+	{
+		err = 1;
+		goto done;
+	}
+	
+	/* deal the jobs, each deque reversed so the owner keeps the order */
+	for(i=0;i<threads;i++)
+	{
+		n = jobs > i ? (jobs - i + threads - 1) / threads : 0;
+		if(!(p.dq[i].job = malloc((n ? n : 1)*sizeof(int))))
+		{
+			err = 1;
+			goto done;
+		}
+		atomic_init(&p.dq[i].top, 0);
+		atomic_init(&p.dq[i].bottom, n);
+	}
+	for(i=0;i<jobs;i++)
+	{
+		n = atomic_load(&p.dq[i % threads].bottom);
+		p.dq[i % threads].job[n - 1 - i/threads] = i;
+	}
+	
+	/* workers that don't start leave their jobs to be stolen */
+	for(n=0;n<threads;n++)
+	{
+		w[n].pool = &p;
+		w[n].worker = n;
+		if(pthread_create(&tid[n], NULL, mvpool_Worker, &w[n]))
+			break;
+	}
+	if(!n)
+		mvpool_Worker(&w[0]);
+	for(i=0;i<n;i++)
+		pthread_join(tid[i], NULL);
+	
+done:
+	if(p.dq)
+		for(i=0;i<threads;i++)
+			free(p.dq[i].job);
+	free(tid);
+	free(w);
+	free(p.dq);
+	
+	return err;
+}
@@ -0,0 +1,14 @@
+/*
+ * mv_pool.h - Midiverb I emulator, work-stealing thread pool
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_pool__
+#define __mv_pool__
+
+/* run job number job on worker thread worker */
+typedef void (*mvpool_job)(void *ctx, int worker, int job);
+
+int mvpool_Run(int threads, int jobs, mvpool_job fn, void *ctx);
+
+#endif
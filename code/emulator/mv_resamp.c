@@ -0,0 +1,170 @@
+/*
+ * mv_resamp.c - Midiverb I emulator, polyphase sample rate conversion
+ * 10-17-26 E. Brombaugh
+ *
+ * Rational L/M conversion of interleaved stereo. The windowed-sinc
+ * prototype is split into L phases of MV_RS_TAPS taps when the converter
+ * is set up, so each output frame is one vector dot product per channel
+ * over the buffered input. Used to run programs at the hardware rate:
+ * host rate -> MV_RATE2 -> program -> host rate.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mv_resamp.h"
+#include "mv_simd.h"
+
+#if MV_RS_TAPS % MV_VLEN
+#error "taps must be a multiple of the vector width"
+#endif
+
+/*
+ * gcd function
+ */
+static uint32_t mvrs_Gcd(uint32_t a, uint32_t b)
+{
+	uint32_t r;
+	
+	while(b)
+	{
+		r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+/*
+ * Set up conversion between two rates given in half Hz, e.g.
+ * mvrs_Init(&rs, 2*48000, MV_RATE2). Returns 1 if out of memory.
+ */
+int mvrs_Init(mvrs *rs, uint32_t from2, uint32_t to2)
+{
+	uint32_t g, p, j, n, len;
+	double fc, t, w, h, sum, *proto;
+	
+	g = mvrs_Gcd(from2, to2);
+	rs->L = to2/g;
+	rs->M = from2/g;
+	rs->phase = 0;
+	rs->pos = 0;
+	rs->fill = MV_RS_TAPS - 1;
+	memset(rs->hist, 0, sizeof(rs->hist));
+	
+	len = rs->L*MV_RS_TAPS;
+	rs->coef = malloc(len*sizeof(int16_t));
+	rs->step = malloc(rs->L*sizeof(uint16_t));
+	proto = malloc(len*sizeof(double));
+	if(!rs->coef || !rs->step || !proto)
+	{
+		free(proto);
+		mvrs_Free(rs);
+		return 1;
+	}
+	
+	/* Blackman windowed sinc at L times the input rate, cut off a bit
+	   below the lower of the two Nyquist rates */
+	fc = 0.45 * (rs->L < rs->M ? (double)rs->L/rs->M : 1.0) / rs->L;
+	for(n=0;n<len;n++)
+	{
+		t = n - (len - 1)/2.0;
+		h = t ? sin(2*M_PI*fc*t)/(M_PI*t) : 2*fc;
+		w = 0.42 - 0.5*cos(2*M_PI*(n + 0.5)/len) +
+			0.08*cos(4*M_PI*(n + 0.5)/len);
+		proto[n] = h*w;
+	}
+	
+	/* phase p, tap j weights input i-j, stored reversed, unity DC gain */
+	for(p=0;p<rs->L;p++)
+	{
+		for(sum=0,j=0;j<MV_RS_TAPS;j++)
+			sum += proto[p + j*rs->L];
+		for(j=0;j<MV_RS_TAPS;j++)
+			rs->coef[p*MV_RS_TAPS + MV_RS_TAPS-1-j] =
+				lrint(16384 * proto[p + j*rs->L] / sum);
+		rs->step[p] = (p + rs->M)/rs->L;
+	}
+	free(proto);
+	
+	return 0;
+}
+
+/*
+ * most output frames that frames input can produce
+ */
+size_t mvrs_MaxOut(const mvrs *rs, size_t frames)
+{
+	return frames*rs->L/rs->M + 2;
+}
+
+/*
+ * group delay of the filter, in output frames
+ */
+double mvrs_Delay(const mvrs *rs)
+{
+	return (MV_RS_TAPS*rs->L - 1) / (2.0*rs->M);
+}
+
+/*
+ * convert interleaved stereo frames, returns output frames
+ */
+size_t mvrs_Proc(mvrs *rs, const int16_t *in, size_t frames, int16_t *out)
+{
+	const int16_t *c;
+	size_t n, j, cnt = 0;
+	int32_t y;
+	uint8_t ch;
+	
+	while(frames)
+	{
+		/* append a chunk after the history, one array per channel */
+		n = frames < MV_RS_BLOCK ? frames : MV_RS_BLOCK;
+		for(j=0;j<n;j++)
+		{
+			rs->hist[0][rs->fill + j] = in[2*j];
+			rs->hist[1][rs->fill + j] = in[2*j+1];
+		}
+		rs->fill += n;
+		in += 2*n;
+		frames -= n;
+	
+		/* every output whose taps are all buffered */
+		while(rs->pos + MV_RS_TAPS <= rs->fill)
+		{
+			c = &rs->coef[rs->phase*MV_RS_TAPS];
+			for(ch=0;ch<2;ch++)
+			{
+				y = v_dot(c, &rs->hist[ch][rs->pos], MV_RS_TAPS) + 8192;
+				y >>= 14;
+				out[ch] = y > 32767 ? 32767 : (y < -32768 ? -32768 : y);
+			}
+			out += 2;
+			cnt++;
+	
+			rs->pos += rs->step[rs->phase];
+			rs->phase = (rs->phase + rs->M) % rs->L;
+		}
+	
+		/* keep what later outputs still need */
+		n = rs->pos < rs->fill ? rs->pos : rs->fill;
+		for(ch=0;ch<2;ch++)
+			memmove(rs->hist[ch], &rs->hist[ch][n],
+				(rs->fill - n)*sizeof(int16_t));
+		rs->fill -= n;
+		rs->pos -= n;
+	}
+	
+	return cnt;
+}
+
+/*
+ * release the filter tables
+ */
+void mvrs_Free(mvrs *rs)
+{
+	free(rs->coef);
+	free(rs->step);
+	rs->coef = NULL;
+	rs->step = NULL;
+}
@@ -0,0 +1,39 @@
+/*
+ * mv_resamp.h - Midiverb I emulator, polyphase sample rate conversion
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_resamp__
+#define __mv_resamp__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* hardware sample rate, 6 MHz/256, in half Hz */
+#define MV_RATE2 46875
+
+/* filter taps per phase, a multiple of the vector width */
+#define MV_RS_TAPS 32
+
+/* input frames per internal chunk */
+#define MV_RS_BLOCK 256
+
+typedef struct
+{
+	uint32_t L;						/* output/input rate = L/M */
+	uint32_t M;
+	uint32_t phase;					/* next output's filter phase */
+	uint32_t pos;					/* next output's oldest input frame */
+	uint32_t fill;					/* input frames buffered */
+	int16_t *coef;					/* [L][MV_RS_TAPS] time reversed, Q14 */
+	uint16_t *step;					/* [L] input frames after each phase */
+	int16_t hist[2][MV_RS_TAPS + MV_RS_BLOCK];	/* input per channel */
+} mvrs;
+
+int mvrs_Init(mvrs *rs, uint32_t from2, uint32_t to2);
+size_t mvrs_MaxOut(const mvrs *rs, size_t frames);
+double mvrs_Delay(const mvrs *rs);
+size_t mvrs_Proc(mvrs *rs, const int16_t *in, size_t frames, int16_t *out);
+void mvrs_Free(mvrs *rs);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * mv_simd.h - 16-bit vector helpers shared by the vector engines
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_simd__
+#define __mv_simd__
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MV_VLEN 16
+typedef __m256i mvvec;
+#define v_load(p)		_mm256_loadu_si256((const __m256i *)(p))
+#define v_store(p,a)	_mm256_storeu_si256((__m256i *)(p), a)
+#define v_set1(x)		_mm256_set1_epi16(x)
+#define v_add(a,b)		_mm256_add_epi16(a, b)
+#define v_sub(a,b)		_mm256_sub_epi16(a, b)
+#define v_and(a,b)		_mm256_and_si256(a, b)
+#define v_xor(a,b)		_mm256_xor_si256(a, b)
+#define v_sra(a,n)		_mm256_srai_epi16(a, n)
+#define v_srl(a,n)		_mm256_srli_epi16(a, n)
+#define v_sll(a,n)		_mm256_slli_epi16(a, n)
+#define v_min(a,b)		_mm256_min_epi16(a, b)
+#define v_max(a,b)		_mm256_max_epi16(a, b)
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MV_VLEN 8
+typedef __m128i mvvec;
+#define v_load(p)		_mm_loadu_si128((const __m128i *)(p))
+#define v_store(p,a)	_mm_storeu_si128((__m128i *)(p), a)
+#define v_set1(x)		_mm_set1_epi16(x)
+#define v_add(a,b)		_mm_add_epi16(a, b)
+#define v_sub(a,b)		_mm_sub_epi16(a, b)
+#define v_and(a,b)		_mm_and_si128(a, b)
+#define v_xor(a,b)		_mm_xor_si128(a, b)
+#define v_sra(a,n)		_mm_srai_epi16(a, n)
+#define v_srl(a,n)		_mm_srli_epi16(a, n)
+#define v_sll(a,n)		_mm_slli_epi16(a, n)
+#define v_min(a,b)		_mm_min_epi16(a, b)
+#define v_max(a,b)		_mm_max_epi16(a, b)
+#else
+/* portable fallback using GCC vector extensions */
+#define MV_VLEN 8
+typedef int16_t mvvec __attribute__((vector_size(2*MV_VLEN)));
+typedef uint16_t mvuvec __attribute__((vector_size(2*MV_VLEN)));
+static inline mvvec v_load(const void *p)
+{
+	mvvec a;
+	memcpy(&a, p, sizeof(a));
+	return a;
+}
+#define v_store(p,a)	memcpy(p, &(a), sizeof(mvvec))
+#define v_set1(x)		((mvvec){} + (int16_t)(x))
+#define v_add(a,b)		((a) + (b))
+#define v_sub(a,b)		((a) - (b))
+#define v_and(a,b)		((a) & (b))
+#define v_xor(a,b)		((a) ^ (b))
+#define v_sra(a,n)		((a) >> (n))
+#define v_srl(a,n)		((mvvec)((mvuvec)(a) >> (n)))
+#define v_sll(a,n)		((a) << (n))
+#define v_min(a,b)		(((a) & ((a) < (b))) | ((b) & ~((a) < (b))))
+#define v_max(a,b)		(((a) & ((a) > (b))) | ((b) & ~((a) > (b))))
+#endif
+
+/* sum of a[j]*b[j], n a multiple of MV_VLEN */
+static inline int32_t v_dot(const int16_t *a, const int16_t *b, int n)
+{
+#if defined(__AVX2__)
+	__m256i sum = _mm256_setzero_si256();
+	__m128i s;
+	int j;
+	
+	for(j=0;j<n;j+=MV_VLEN)
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v_load(&a[j]),
+			v_load(&b[j])));
+	s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+		_mm256_extracti128_si256(sum, 1));
+#elif defined(__SSE2__)
+	__m128i s = _mm_setzero_si128();
+	int j;
+	
+	for(j=0;j<n;j+=MV_VLEN)
+		s = _mm_add_epi32(s, _mm_madd_epi16(v_load(&a[j]), v_load(&b[j])));
+#else
+	int32_t s = 0;
+	int j;
+	
+	for(j=0;j<n;j++)
+		s += a[j]*b[j];
+	return s;
+#endif
+#if defined(__SSE2__)
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+#endif
+}
+
+/* acc = ai/2 + sgn + (keep ? acc : 0) */
+#define v_acc(ai,acc,keep)	v_add(v_add(v_sra(ai, 1), v_srl(ai, 15)), \
+							v_and(acc, v_set1(keep)))
+
+/* saturate & scale for the DACs */
+#define v_dac(a)		v_sll(v_min(v_max(a, v_set1(-4096)), v_set1(4095)), 3)
+
+/* p[2*j] = a[j], p[2*j+1] = b[j], i.e. L/R pairs per lane */
+static inline void v_store2(int16_t *p, mvvec a, mvvec b)
+{
+#if defined(__AVX2__)
+	/* unpacking works within 128-bit halves, so swap the middle quarters */
+	__m256i lo = _mm256_unpacklo_epi16(a, b), hi = _mm256_unpackhi_epi16(a, b);
+	
+	v_store(p, _mm256_permute2x128_si256(lo, hi, 0x20));
+	v_store(p + MV_VLEN, _mm256_permute2x128_si256(lo, hi, 0x31));
+#elif defined(__SSE2__)
+	v_store(p, _mm_unpacklo_epi16(a, b));
+	v_store(p + MV_VLEN, _mm_unpackhi_epi16(a, b));
+#else
+	int16_t ta[MV_VLEN], tb[MV_VLEN];
+	int j;
+	
+	v_store(ta, a);
+	v_store(tb, b);
+	for(j=0;j<MV_VLEN;j++)
+	{
+		p[2*j] = ta[j];
+		p[2*j+1] = tb[j];
+	}
+#endif
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * mv_snap.c - Midiverb I emulator, instance state snapshots
+ * 10-17-26 E. Brombaugh
+ *
+ * The whole state of an instance is prog, acc, asum and the DRAM ring, the
+ * decoded program is rebuilt from prog. DRAM is either stored raw, so a
+ * restore is one memcpy, or as alternating literal and zero runs:
+ *   uint16 literals, that many words, uint16 zeros, ...
+ * which restores as a memcpy & memset per run.
+ */
+
+#include <string.h>
+#include "mv_snap.h"
+
+/* zero runs shorter than this stay in the literals */
+#define MIN_ZRUN 3
+
+/*
+ * code DRAM as runs into buf, returns bytes used or 0 if it won't fit
+ */
+static size_t mvsnap_Rle(const int16_t *dram, uint16_t ring, uint8_t *buf,
+	size_t len)
+{
+	size_t used = 0;
+	uint16_t i, lit, z, n;
+	
+	i = 0;
+	while(i < ring)
+	{
+		/* literals up to the next long enough zero run */
+		lit = i;
+		z = 0;
+		while(i < ring)
+		{
+			for(z=0;(i+z < ring) && !dram[i+z];z++);
+			if((z >= MIN_ZRUN) || (i+z == ring))
+				break;
+			i += z + 1;
+		}
+		if(i == ring)
+			z = 0;
+		n = i - lit;
+	
+		if(used + 2*sizeof(uint16_t) + n*sizeof(int16_t) > len)
+			return 0;
+		memcpy(&buf[used], &n, sizeof(uint16_t));
+		used += sizeof(uint16_t);
+		memcpy(&buf[used], &dram[lit], n*sizeof(int16_t));
+		used += n*sizeof(int16_t);
+		memcpy(&buf[used], &z, sizeof(uint16_t));
+		used += sizeof(uint16_t);
+		i += z;
+	}
+	
+	return used;
+}
+
+/*
+ * save the state of an instance into buf, returns bytes used or 0 if buf
+ * is too small. MV_SNAP_MAX() bytes are always enough. An idle instance
+ * has its DRAM brought up to date first.
+ */
+size_t mvsnap_Save(mvblk *blk, void *buf, size_t len, uint8_t flags)
+{
+	uint8_t *p = buf;
+	mvshdr hdr;
+	size_t raw;
+	
+	midiverb_Sync(blk);
+	memcpy(hdr.magic, MV_SNAP_MAGIC, 4);
+	hdr.version = MV_SNAP_VERSION;
+	hdr.prog = blk->prog;
+	hdr.flags = 0;
+	hdr.acc = blk->acc;
+	hdr.asum = blk->asum;
+	hdr.ring = blk->mask + 1;
+	hdr.engine = blk->engine;
+	hdr.pad = 0;
+	
+	if(len < sizeof(mvshdr))
+		return 0;
+	len -= sizeof(mvshdr);
+	raw = hdr.ring*sizeof(int16_t);
+	
+	/* runs only when they come out smaller */
+	if(flags & MV_SNAP_RLE)
+	{
+		hdr.len = mvsnap_Rle(blk->dram, hdr.ring, &p[sizeof(mvshdr)],
+			len < raw ? len : raw - 1);
+		if(hdr.len)
+			hdr.flags = MV_SNAP_RLE;
+	}
+	
+	if(!hdr.flags)
+	{
+		if(len < raw)
+			return 0;
+		memcpy(&p[sizeof(mvshdr)], blk->dram, raw);
+		hdr.len = raw;
+	}
+	
+	memcpy(p, &hdr, sizeof(mvshdr));
+	return sizeof(mvshdr) + hdr.len;
+}
+
+/*
+ * restore an instance with the same DRAM ring size from a snapshot,
+ * returns 1 if it isn't a valid snapshot for this instance
+ */
+int mvsnap_Load(mvblk *blk, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	mvshdr hdr;
+	uint16_t i, n, z;
+	size_t used;
+	
+	if(len < sizeof(mvshdr))
+		return 1;
+	memcpy(&hdr, p, sizeof(mvshdr));
+	if(memcmp(hdr.magic, MV_SNAP_MAGIC, 4) ||
+		(hdr.version != MV_SNAP_VERSION) || (hdr.ring != blk->mask + 1) ||
+		(hdr.len > len - sizeof(mvshdr)))
+		return 1;
+	p += sizeof(mvshdr);
+	
+	if(hdr.flags & MV_SNAP_RLE)
+	{
+		/* check the runs before touching the instance */
+		for(i=0,used=0;i<hdr.ring;i+=n+z)
+		{
+			if(used + 2*sizeof(uint16_t) > hdr.len)
+				return 1;
+			memcpy(&n, &p[used], sizeof(uint16_t));
+			used += sizeof(uint16_t) + n*sizeof(int16_t);
+			if(used + sizeof(uint16_t) > hdr.len)
+				return 1;
+			memcpy(&z, &p[used], sizeof(uint16_t));
+			used += sizeof(uint16_t);
+			if(n + z > hdr.ring - i)
+				return 1;
+		}
+	
+		for(i=0,used=0;i<hdr.ring;i+=n+z)
+		{
+			memcpy(&n, &p[used], sizeof(uint16_t));
+			used += sizeof(uint16_t);
+			memcpy(&blk->dram[i], &p[used], n*sizeof(int16_t));
+			used += n*sizeof(int16_t);
+			memcpy(&z, &p[used], sizeof(uint16_t));
+			used += sizeof(uint16_t);
+			memset(&blk->dram[i+n], 0, z*sizeof(int16_t));
+		}
+	}
+	else
+	{
+		if(hdr.len != hdr.ring*sizeof(int16_t))
+			return 1;
+		memcpy(blk->dram, p, hdr.len);
+	}
+	
+	/* decoding is only needed for a different program */
+	if(blk->prog != hdr.prog)
+		midiverb_SetProg(blk, hdr.prog);
+	blk->engine = hdr.engine;
+	blk->acc = hdr.acc;
+	blk->asum = hdr.asum;
+	blk->idle = 0;
+	blk->quiet = 0;
+	
+	return 0;
+}
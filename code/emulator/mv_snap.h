@@ -0,0 +1,40 @@
+/*
+ * mv_snap.h - Midiverb I emulator, instance state snapshots
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_snap__
+#define __mv_snap__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midiverb.h"
+
+/* snapshot header */
+#define MV_SNAP_MAGIC "MVSN"
+#define MV_SNAP_VERSION 1
+
+/* flags */
+#define MV_SNAP_RLE 0x01			/* zero runs in DRAM are coded */
+
+typedef struct
+{
+	char magic[4];					/* MV_SNAP_MAGIC */
+	uint16_t version;				/* MV_SNAP_VERSION */
+	uint8_t prog;					/* program index */
+	uint8_t flags;					/* MV_SNAP_ flags */
+	int16_t acc;					/* accumulator */
+	uint16_t asum;					/* Address Gen */
+	uint16_t ring;					/* DRAM words */
+	uint8_t engine;					/* execution engine */
+	uint8_t pad;
+	uint32_t len;					/* DRAM bytes that follow */
+} mvshdr;
+
+/* largest snapshot of an instance, RLE never makes it bigger */
+#define MV_SNAP_MAX(blk) (sizeof(mvshdr) + ((blk)->mask + 1)*sizeof(int16_t))
+
+size_t mvsnap_Save(mvblk *blk, void *buf, size_t len, uint8_t flags);
+int mvsnap_Load(mvblk *blk, const void *buf, size_t len);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * mv_switch.c - Midiverb I emulator, real-time safe program changes
+ * 10-17-26 E. Brombaugh
+ *
+ * A control thread decodes the new program into a standby instance with
+ * clean DRAM and hands it over ready through a one slot mailbox. The audio
+ * thread takes it at a block boundary, lets it run unheard for a while so
+ * its delay lines fill, then crossfades to it, swaps and hands the old one
+ * back. Nothing here locks, allocates or decodes on the audio thread.
+ */
+
+#include <string.h>
+#include "mv_switch.h"
+
+/*
+ * Set up switching between two initialized instances, cur running the
+ * program heard now. Both must stay owned by the switch from here on.
+ */
+void mvswitch_Init(mvswitch *sw, mvblk *cur, mvblk *spare, uint32_t warm,
+	uint32_t xfade)
+{
+	sw->cur = cur;
+	sw->spare = NULL;
+	sw->standby = spare;
+	sw->warm = warm;
+	sw->xfade = xfade;
+	sw->pos = 0;
+	sw->state = MV_SW_IDLE;
+	atomic_init(&sw->ready, NULL);
+	atomic_init(&sw->done, NULL);
+}
+
+/*
+ * request a program change - control thread only. The ring clear and the
+ * decode with its analysis happen here. A change posted before the last
+ * was taken replaces it. Returns 1 while the last change is still fading
+ * in and both instances are busy, so try again later.
+ */
+int mvswitch_Post(mvswitch *sw, uint8_t prog)
+{
+	mvblk *blk = sw->standby;
+	uint8_t engine;
+	
+	/* take back one the audio thread hasn't started, or has finished */
+	if(!blk)
+		blk = atomic_exchange_explicit(&sw->ready, NULL,
+			memory_order_acquire);
+	if(!blk)
+		blk = atomic_exchange_explicit(&sw->done, NULL,
+			memory_order_acquire);
+	if(!blk)
+		return 1;
+	
+	/* clean DRAM, so nothing of an older program is heard */
+	engine = blk->engine;
+	midiverb_InitRing(blk, blk->mask + 1);
+	midiverb_SetEngine(blk, engine);
+	midiverb_SetProg(blk, prog);
+	
+	/* the instance is complete before the audio thread can see it */
+	sw->standby = NULL;
+	atomic_store_explicit(&sw->ready, blk, memory_order_release);
+	return 0;
+}
+
+/*
+ * take a decoded instance, if any, and start warming it
+ */
+static void mvswitch_Start(mvswitch *sw)
+{
+	mvblk *blk;
+	
+	if(!atomic_load_explicit(&sw->ready, memory_order_relaxed))
+		return;
+	if(!(blk = atomic_exchange_explicit(&sw->ready, NULL,
+		memory_order_acquire)))
+		return;
+	
+	sw->spare = blk;
+	sw->pos = 0;
+	sw->state = MV_SW_WARM;
+}
+
+/*
+ * process a block of interleaved stereo frames - audio thread only
+ */
+void mvswitch_ProcBlock(mvswitch *sw, const int16_t *in, int16_t *out,
+	size_t frames)
+{
+	mvblk *t;
+	size_t n, j;
+	int32_t g;
+	
+	if(sw->state == MV_SW_IDLE)
+		mvswitch_Start(sw);
+	
+	while(frames)
+	{
+		if(sw->state == MV_SW_IDLE)
+		{
+			midiverb_ProcBlock(sw->cur, in, out, frames);
+			return;
+		}
+	
+		/* a chunk never crosses a state change */
+		n = frames < MV_SW_BLOCK ? frames : MV_SW_BLOCK;
+		if(sw->state == MV_SW_WARM)
+		{
+			if(n > sw->warm - sw->pos)
+				n = sw->warm - sw->pos;
+		}
+		else if(n > sw->xfade - sw->pos)
+			n = sw->xfade - sw->pos;
+	
+		if(n)
+		{
+			midiverb_ProcBlock(sw->cur, in, out, n);
+			midiverb_ProcBlock(sw->spare, in, sw->tmp, n);
+	
+			/* linear fade, Q15 gain on the new program */
+			if(sw->state == MV_SW_FADE)
+				for(j=0;j<n;j++)
+				{
+					g = ((uint64_t)(sw->pos + j) << 15) / sw->xfade;
+					out[2*j] += ((sw->tmp[2*j] - out[2*j]) * g) >> 15;
+					out[2*j+1] += ((sw->tmp[2*j+1] - out[2*j+1]) * g) >> 15;
+				}
+	
+			sw->pos += n;
+			in += 2*n;
+			out += 2*n;
+			frames -= n;
+		}
+	
+		/* next state */
+		if(sw->state == MV_SW_WARM)
+		{
+			if(sw->pos >= sw->warm)
+			{
+				sw->state = MV_SW_FADE;
+				sw->pos = 0;
+			}
+		}
+		else if(sw->pos >= sw->xfade)
+		{
+			t = sw->cur;
+			sw->cur = sw->spare;
+			sw->spare = NULL;
+			sw->state = MV_SW_IDLE;
+			atomic_store_explicit(&sw->done, t, memory_order_release);
+		}
+	}
+}
@@ -0,0 +1,45 @@
+/*
+ * mv_switch.h - Midiverb I emulator, real-time safe program changes
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_switch__
+#define __mv_switch__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "midiverb.h"
+
+/* frames per chunk while both instances run */
+#define MV_SW_BLOCK 256
+
+/* transition states */
+enum
+{
+	MV_SW_IDLE,						/* only the current instance runs */
+	MV_SW_WARM,						/* new program fills its DRAM unheard */
+	MV_SW_FADE,						/* crossfade old to new */
+};
+
+typedef struct
+{
+	mvblk *cur;						/* instance being heard */
+	mvblk *spare;					/* instance for the next program */
+	mvblk *standby;					/* instance to decode into, control */
+	_Atomic(mvblk *) ready;			/* decoded, not yet taken by audio */
+	_Atomic(mvblk *) done;			/* faded out, back to the control side */
+	uint32_t warm;					/* frames to pre-warm the new program */
+	uint32_t xfade;					/* crossfade frames */
+	uint32_t pos;					/* frames into the current state */
+	uint8_t state;					/* transition state */
+	int16_t tmp[2*MV_SW_BLOCK];		/* spare instance output */
+} mvswitch;
+
+void mvswitch_Init(mvswitch *sw, mvblk *cur, mvblk *spare, uint32_t warm,
+	uint32_t xfade);
+int mvswitch_Post(mvswitch *sw, uint8_t prog);
+void mvswitch_ProcBlock(mvswitch *sw, const int16_t *in, int16_t *out,
+	size_t frames);
+
+#endif
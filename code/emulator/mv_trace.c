@@ -0,0 +1,102 @@
+/*
+ * mv_trace.c - Midiverb I emulator, binary instruction trace
+ * 10-17-26 E. Brombaugh
+ *
+ * Records are captured into a preallocated ring and written out with one
+ * fwrite per ring fill, then turned back into the text that the old
+ * per-instruction fprintf diagnostics produced by mvtrace_Text().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "mv_trace.h"
+
+/*
+ * Allocate a ring of size records, rounded up to a power of two. The file
+ * header is written at once if a file is given.
+ */
+int mvtrace_Init(mvtrace *tr, uint32_t size, FILE *file)
+{
+	mvthdr hdr;
+	uint32_t len;
+	
+	for(len=1;len<size;len<<=1);
+	if(!(tr->rec = malloc(len*sizeof(mvtrec))))
+		return 1;
+	tr->mask = len-1;
+	tr->head = 0;
+	tr->tail = 0;
+	tr->file = file;
+	
+	if(file)
+	{
+		memcpy(hdr.magic, MV_TRACE_MAGIC, 4);
+		hdr.version = MV_TRACE_VERSION;
+		hdr.recsz = sizeof(mvtrec);
+		if(fwrite(&hdr, sizeof(mvthdr), 1, file) != 1)
+		{
+			free(tr->rec);
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+/*
+ * write records not yet in the file, at most the last ring's worth
+ */
+void mvtrace_Flush(mvtrace *tr)
+{
+	uint32_t start, n;
+	
+	if(!tr->file)
+		return;
+	
+	/* older records have been overwritten */
+	if(tr->head - tr->tail > tr->mask + 1)
+		tr->tail = tr->head - (tr->mask + 1);
+	
+	/* at most two runs around the end of the ring */
+	while(tr->tail != tr->head)
+	{
+		start = tr->tail & tr->mask;
+		n = tr->head - tr->tail;
+		if(n > tr->mask + 1 - start)
+			n = tr->mask + 1 - start;
+		fwrite(&tr->rec[start], sizeof(mvtrec), n, tr->file);
+		tr->tail += n;
+	}
+}
+
+/*
+ * release the ring, pending records go to the file first
+ */
+void mvtrace_Free(mvtrace *tr)
+{
+	mvtrace_Flush(tr);
+	free(tr->rec);
+	tr->rec = NULL;
+}
+
+/*
+ * decode a binary trace into the diagnostic text format
+ */
+int mvtrace_Text(FILE *bin, FILE *txt)
+{
+	mvthdr hdr;
+	mvtrec rec[256];
+	size_t n, i;
+	
+	if((fread(&hdr, sizeof(mvthdr), 1, bin) != 1) ||
+		memcmp(hdr.magic, MV_TRACE_MAGIC, 4) ||
+		(hdr.version != MV_TRACE_VERSION) || (hdr.recsz != sizeof(mvtrec)))
+		return 1;
+	
+	while((n = fread(rec, sizeof(mvtrec), 256, bin)) > 0)
+		for(i=0;i<n;i++)
+			fprintf(txt, "%02x %1x %04x %04x %04x %04x \n", rec[i].i,
+				rec[i].op, rec[i].addr, rec[i].asum, rec[i].ai, rec[i].acc);
+	
+	return 0;
+}
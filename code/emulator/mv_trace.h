@@ -0,0 +1,67 @@
+/*
+ * mv_trace.h - Midiverb I emulator, binary instruction trace
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_trace__
+#define __mv_trace__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* file header */
+#define MV_TRACE_MAGIC "MVTR"
+#define MV_TRACE_VERSION 1
+
+typedef struct
+{
+	char magic[4];					/* MV_TRACE_MAGIC */
+	uint16_t version;				/* MV_TRACE_VERSION */
+	uint16_t recsz;					/* sizeof(mvtrec) */
+} mvthdr;
+
+/* one record per instruction, state before it updates acc & asum */
+typedef struct
+{
+	uint8_t i;						/* instruction index */
+	uint8_t op;						/* opcode */
+	uint16_t addr;					/* address increment */
+	uint16_t asum;					/* Address Gen */
+	uint16_t ai;					/* AI bus */
+	uint16_t acc;					/* accumulator */
+} mvtrec;
+
+typedef struct
+{
+	mvtrec *rec;					/* record ring, power of two long */
+	uint32_t mask;					/* ring length - 1 */
+	uint32_t head;					/* records captured */
+	uint32_t tail;					/* records written to file */
+	FILE *file;						/* bulk dump, NULL keeps the last ones */
+} mvtrace;
+
+int mvtrace_Init(mvtrace *tr, uint32_t size, FILE *file);
+void mvtrace_Flush(mvtrace *tr);
+void mvtrace_Free(mvtrace *tr);
+int mvtrace_Text(FILE *bin, FILE *txt);
+
+/*
+ * capture one record, dumping the ring to file each time it fills
+ */
+static inline void mvtrace_Rec(mvtrace *tr, uint8_t i, uint8_t op,
+	uint16_t addr, uint16_t asum, int16_t ai, int16_t acc)
+{
+	mvtrec *r = &tr->rec[tr->head & tr->mask];
+	
+	r->i = i;
+	r->op = op;
+	r->addr = addr;
+	r->asum = asum;
+	r->ai = ai;
+	r->acc = acc;
+	
+	if(!(++tr->head & tr->mask) && tr->file)
+		mvtrace_Flush(tr);
+}
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * mv_tvec.c - Midiverb I emulator, instruction-major vector execution
+ * 10-17-26 E. Brombaugh
+ *
+ * Each program is a fixed graph of taps at asum + const. When no DRAM
+ * dependency is shorter than B samples (see midiverb_MaxBlock()) the
+ * sample & instruction loops can be swapped: every instruction runs over
+ * B consecutive samples at once and its DRAM accesses are contiguous.
+ */
+
+#include <string.h>
+#include "mv_tvec.h"
+#include "mv_simd.h"
+
+/*
+ * one instruction on one sample
+ */
+static inline void mvtvec_One(const mvdec *dec, uint8_t i, int16_t *p,
+	int16_t *acc, int16_t *dac)
+{
+	int16_t ai;
+	
+	ai = dec->rd[i] ? *p : *acc ^ dec->inv[i];
+	if(dec->wr[i])
+		*p = ai;
+	
+	if(dac)
+	{
+		if(ai > 4095)
+			ai = 4095;
+		else if(ai < -4096)
+			ai = -4096;
+		*dac = ai << 3;
+	}
+	else
+		*acc = (ai>>1) + (*acc & dec->keep[i]) + ((uint16_t)ai >> 15);
+}
+
+/*
+ * one instruction over n samples starting at DRAM address a0
+ */
+static void mvtvec_Row(const mvdec *dec, uint8_t i, int16_t *dram,
+	uint16_t a0, int16_t *acc, int16_t *dac, size_t n)
+{
+	mvvec ai, va;
+	uint16_t a;
+	size_t c, j;
+	
+	for(c=0;c<n;c+=MV_VLEN)
+	{
+		a = (a0 + c)&0x3fff;
+		
+		/* partial chunks & chunks that wrap the DRAM go one at a time */
+		if((c + MV_VLEN > n) || (a > 16384 - MV_VLEN))
+		{
+			for(j=c;(j<n) && (j<c+MV_VLEN);j++)
+				mvtvec_One(dec, i, &dram[(a0 + j)&0x3fff], &acc[j],
+					dac ? &dac[j] : NULL);
+			continue;
+		}
+		
+		va = v_load(&acc[c]);
+		if(dec->rd[i])
+			ai = v_load(&dram[a]);
+		else
+			ai = v_xor(va, v_set1(dec->inv[i]));
+		
+		if(dec->wr[i])
+			v_store(&dram[a], ai);
+		
+		if(dac)
+		{
+			ai = v_dac(ai);
+			v_store(&dac[c], ai);
+		}
+		else
+		{
+			va = v_acc(ai, va, dec->keep[i]);
+			v_store(&acc[c], va);
+		}
+	}
+}
+
+/*
+ * run n <= maxblk samples instruction-major
+ */
+static void mvtvec_Run(mvblk *blk, const int16_t *in, int16_t *out,
+	size_t n)
+{
+	const mvdec *dec = &blk->dec;
+	int16_t acc[MV_MAXBLOCK], dac[MV_MAXBLOCK];
+	uint16_t asum = blk->asum;
+	uint8_t i;
+	size_t j;
+	
+	/* ADC slot - acc from the previous sample is always discarded */
+	for(j=0;j<n;j++)
+	{
+		dac[j] = ((in[2*j]>>4) + (in[2*j+1]>>4)) & 0xFFFE;
+		acc[j] = blk->acc;
+	}
+	for(j=0;j<n;j++)
+		blk->dram[(asum + j)&0x3fff] = dac[j];
+	for(j=0;j<n;j++)
+		acc[j] = (dac[j]>>1) + (acc[j] & dec->keep[0]) +
+			((uint16_t)dac[j] >> 15);
+	
+	for(i=1;i<128;i++)
+	{
+		if((i==0x60)||(i==0x70))
+		{
+			mvtvec_Row(dec, i, blk->dram, asum + dec->off[i], acc, dac, n);
+			for(j=0;j<n;j++)
+				out[2*j + ((i==0x60) ? 1 : 0)] = dac[j];
+		}
+		else
+			mvtvec_Row(dec, i, blk->dram, asum + dec->off[i], acc, NULL, n);
+	}
+	
+	blk->acc = acc[n-1];
+	blk->asum = (asum + n)&0x3fff;
+}
+
+/*
+ * process a block of interleaved stereo frames, falling back to the
+ * sample-major engines when feedback is too short or DRAM is a short ring
+ */
+void mvtvec_ProcBlock(mvblk *blk, const int16_t *in, int16_t *out,
+	size_t frames)
+{
+	size_t n;
+	
+	if((blk->prog > 62) || MV_TRACING(blk) || (blk->dec.sum != 1) ||
+		(blk->dec.maxblk < MV_TV_MINBLOCK) || (blk->mask != 0x3fff))
+	{
+		midiverb_ProcBlock(blk, in, out, frames);
+		return;
+	}
+	
+	/* idle tracking starts over */
+	midiverb_Wake(blk);
+	blk->nexec += frames;
+	
+	while(frames)
+	{
+		n = frames < blk->dec.maxblk ? frames : blk->dec.maxblk;
+		mvtvec_Run(blk, in, out, n);
+		in += 2*n;
+		out += 2*n;
+		frames -= n;
+	}
+}
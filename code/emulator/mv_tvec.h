@@ -0,0 +1,19 @@
+/*
+ * mv_tvec.h - Midiverb I emulator, instruction-major vector execution
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __mv_tvec__
+#define __mv_tvec__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "midiverb.h"
+
+/* shortest block worth running instruction-major */
+#define MV_TV_MINBLOCK 16
+
+void mvtvec_ProcBlock(mvblk *blk, const int16_t *in, int16_t *out,
+	size_t frames);
+
+#endif
@@ -0,0 +1,275 @@
+/* mvrender.c - render a batch of .wav files thru midiverb programs */
+/* 10-17-26 E. Brombaugh */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "wav_ops.h"
+#include "wav_conv.h"
+#include "midiverb.h"
+#include "mv_chain.h"
+#include "mv_pool.h"
+
+/* one line of the manifest */
+typedef struct
+{
+	int prog;
+	char *iname, *oname;
+	off_t size;						/* input bytes, to order by */
+} rjob;
+
+/* a worker's instance, reused for every job it runs */
+typedef struct
+{
+	mvblk mv;
+	mvchain c;
+} rworker;
+
+typedef struct
+{
+	rjob *job;
+	rworker *w;
+	int native, analog;
+	atomic_int err;					/* jobs that failed */
+	atomic_llong samples;			/* over all jobs */
+} rbatch;
+
+/*
+ * seconds since some fixed point
+ */
+static double now(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/*
+ * render one job, the same way as sim_midiverb, returns 1 on error
+ */
+static int render(rbatch *b, rworker *w, rjob *j)
+{
+	int fmt, err = 1;
+	int32_t samples;
+	wav_map imap, omap;
+	mvpcm src, dst;
+	wav_hdr wh;
+	double t0;
+	
+	t0 = now();
+	if(wav_map_read(&imap, j->iname))
+	{
+		fprintf(stderr, "Couldn't map input file %s for read\n", j->iname);
+		return 1;
+	}
+	wh = imap.hdr;
+	if((fmt = wav_conv_fmt(&wh)) < 0)
+	{
+		fprintf(stderr, "Incorrect input file format %s\n", j->iname);
+		goto unmap;
+	}
+	samples = wh.data_sz / wh.fmt_bytesmpl;
+	
+	midiverb_Init(&w->mv);
+	midiverb_SetProg(&w->mv, j->prog);
+	if(mvchain_Init(&w->c, wh.fmt_smplrate, b->native, b->analog, &w->mv,
+		NULL))
+	{
+		fprintf(stderr, "Out of memory\n");
+		goto done;
+	}
+	if(wav_map_write(&omap, j->oname, &wh))
+	{
+		fprintf(stderr, "Couldn't map output file %s for write\n", j->oname);
+		goto done;
+	}
+	src = (mvpcm){imap.data, fmt, wh.fmt_chls, wh.fmt_bytesmpl};
+	dst = (mvpcm){omap.data, fmt, wh.fmt_chls, wh.fmt_bytesmpl};
+	mvchain_Render(&w->c, &src, &dst, 0, samples, NULL, NULL);
+	wav_unmap(&omap);
+	err = 0;
+	
+	t0 = now() - t0;
+	fprintf(stdout, "%s prog %d -> %s: %ld samples in %.3f s, "
+		"%.0f samples/s\n", j->iname, j->prog, j->oname, (long)samples, t0,
+		t0 > 0 ? samples/t0 : 0.0);
+	atomic_fetch_add(&b->samples, samples);
+	
+done:
+	mvchain_Free(&w->c);
+unmap:
+	wav_unmap(&imap);
+	return err;
+}
+
+/*
+ * pool job
+ */
+static void render_job(void *ctx, int worker, int job)
+{
+	rbatch *b = ctx;
+	
+	if(render(b, &b->w[worker], &b->job[job]))
+		atomic_fetch_add(&b->err, 1);
+}
+
+/*
+ * longest input first
+ */
+static int bysize(const void *a, const void *b)
+{
+	const rjob *ja = a, *jb = b;
+	
+	return (jb->size > ja->size) - (jb->size < ja->size);
+}
+
+/*
+ * read "prog in.wav out.wav" lines, # starts a comment. Returns the number
+ * of jobs or -1.
+ */
+static int load_manifest(char *mname, rjob **jobs)
+{
+	char line[1024], iname[512], oname[512];
+	int n = 0, max = 0, prog, lnum = 0, err = 0;
+	struct stat st;
+	rjob *job = NULL, *tmp;
+	FILE *file;
+	
+	if(!(file = fopen(mname, "r")))
+	{
+		fprintf(stderr, "Couldn't open manifest %s\n", mname);
+		return -1;
+	}
+	while(fgets(line, sizeof(line), file))
+	{
+		lnum++;
+		if(strchr(line, '#'))
+			*strchr(line, '#') = 0;
+		if(strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		if((sscanf(line, "%d %511s %511s", &prog, iname, oname) != 3) ||
+			(prog < 0) || (prog > 62))
+		{
+			fprintf(stderr, "%s:%d: expected prog in.wav out.wav\n", mname,
+				lnum);
+			err = 1;
+			break;
+		}
+		if(n == max)
+		{
+			max = max ? 2*max : 64;
+			if(!(tmp = realloc(job, max*sizeof(rjob))))
+			{
+				fprintf(stderr, "Out of memory\n");
+				err = 1;
+				break;
+			}
+			job = tmp;
+		}
+		job[n].prog = prog;
+		job[n].iname = strdup(iname);
+		job[n].oname = strdup(oname);
+		job[n].size = stat(iname, &st) ? 0 : st.st_size;
+		n++;
+	}
+	fclose(file);
+	
+	if(err)
+	{
+		while(n--)
+		{
+			free(job[n].iname);
+			free(job[n].oname);
+		}
+		free(job);
+		return -1;
+	}
+	*jobs = job;
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 0, njobs, opt, i;
+	rbatch b = {0};
+	double t0;
+	
+	/*
+	 * -n runs the programs at the hardware sample rate, -a adds the analog
+	 * filters, -j sets the worker threads, one per core by default
+	 */
+	while((opt = getopt(argc, argv, "naj:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n':
+				b.native = 1;
+				break;
+	
+			case 'a':
+				b.analog = 1;
+				break;
+	
+			case 'j':
+				threads = atoi(optarg);
+				break;
+	
+			default:
+				fprintf(stderr, "Usage: %s [-n] [-a] [-j threads] manifest\n",
+					argv[0]);
+				exit(1);
+		}
+	}
+	if(optind != argc - 1)
+	{
+		fprintf(stderr, "Usage: %s [-n] [-a] [-j threads] manifest\n",
+			argv[0]);
+		exit(1);
+	}
+	
+	if((njobs = load_manifest(argv[optind], &b.job)) < 0)
+		exit(1);
+	qsort(b.job, njobs, sizeof(rjob), bysize);
+	
+	if(threads < 1)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	threads = threads < 1 ? 1 : threads;
+	threads = threads > njobs ? (njobs ? njobs : 1) : threads;
+	if(!(b.w = malloc(threads*sizeof(rworker))))
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	atomic_init(&b.err, 0);
+	atomic_init(&b.samples, 0);
+	
+	t0 = now();
+	if(mvpool_Run(threads, njobs, render_job, &b))
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	t0 = now() - t0;
+	
+	fprintf(stdout, "%d jobs on %d threads: %lld samples in %.3f s, "
+		"%.0f samples/s\n", njobs, threads,
+		(long long)atomic_load(&b.samples), t0,
+		t0 > 0 ? atomic_load(&b.samples)/t0 : 0.0);
+	if(atomic_load(&b.err))
+		fprintf(stderr, "%d jobs failed\n", atomic_load(&b.err));
+	
+	for(i=0;i<njobs;i++)
+	{
+		free(b.job[i].iname);
+		free(b.job[i].oname);
+	}
+	free(b.job);
+	free(b.w);
+	exit(atomic_load(&b.err) ? 1 : 0);
+}
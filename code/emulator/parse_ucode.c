@@ -223,5 +223,29 @@ done:
 	}
 #endif
 	
+	/* tap span - used locations less the widest unused gap around the ring */
+	{
+		int first = -1, last = -1, gap = 0, span, ring;
+		
+		for(i=0;i<16384;i++)
+		{
+			if((wsb[i]==0) && (rsb[i]==0))
+				continue;
+			if(first < 0)
+				first = i;
+			else if(i - last > gap)
+				gap = i - last;
+			last = i;
+		}
+		if(first >= 0)
+		{
+			if(first + 16384 - last > gap)
+				gap = first + 16384 - last;
+			span = 16384 - gap + 1;
+			for(ring=1;ring<span;ring<<=1);
+			fprintf(stdout, "\nmax tap span: %d, ring >= %d\n", span, ring);
+		}
+	}
+	
 	exit(0);
 }
@@ -4,21 +4,398 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "wav_ops.h"
+#include "wav_conv.h"
 #include "midiverb.h"
+#include "mv_snap.h"
+#include "mv_chain.h"
+#include "mv_pipe.h"
+
+/* checkpoint buffer, frames done then an instance snapshot */
+static uint8_t snap[sizeof(mvshdr) + 16384*sizeof(int16_t)];
+
+/*
+ * save a checkpoint, replacing the old one only once it's complete
+ */
+static int save_ckpt(char *cname, int32_t scnt, mvblk *blk)
+{
+	char tname[260];
+	FILE *file;
+	size_t len;
+	
+	snprintf(tname, sizeof(tname), "%s.tmp", cname);
+	len = mvsnap_Save(blk, snap, sizeof(snap), MV_SNAP_RLE);
+	if(!(file = fopen(tname, "wb")))
+		return 1;
+	if((fwrite(&scnt, sizeof(int32_t), 1, file) != 1) ||
+		(fwrite(snap, 1, len, file) != len))
+	{
+		fclose(file);
+		return 1;
+	}
+	fclose(file);
+	return rename(tname, cname);
+}
+
+/*
+ * load a checkpoint, returns frames done or -1
+ */
+static int32_t load_ckpt(char *cname, mvblk *blk)
+{
+	FILE *file;
+	int32_t scnt;
+	size_t len;
+	
+	if(!(file = fopen(cname, "rb")))
+		return -1;
+	if(fread(&scnt, sizeof(int32_t), 1, file) != 1)
+		scnt = -1;
+	len = fread(snap, 1, sizeof(snap), file);
+	fclose(file);
+	if(mvsnap_Load(blk, snap, len))
+		return -1;
+	return scnt;
+}
+
+/*
+ * checkpoints taken by the serial render
+ */
+typedef struct
+{
+	wav_map *omap;					/* output, synced before each one */
+	char *cname;
+	int32_t every, next;			/* frames */
+} simckpt;
+
+/*
+ * render step, checkpoint between program changes, output saved first
+ */
+static int sim_step(void *ctx, mvchain *c)
+{
+	simckpt *k = ctx;
+	
+	if((c->taken >= k->next) && (c->sw.state == MV_SW_IDLE))
+	{
+		wav_map_sync(k->omap);
+		if(save_ckpt(k->cname, c->taken, c->sw.cur))
+			fprintf(stderr, "Couldn't write checkpoint %s\n", k->cname);
+		k->next = c->taken + k->every;
+	}
+	
+	return 0;
+}
+
+/*
+ * pipeline DSP stage
+ */
+static size_t sim_dsp(void *ctx, int16_t *in, size_t frames, int16_t *out)
+{
+	return mvchain_Proc(ctx, in, frames, out);
+}
+
+/*
+ * one end of the pipelined mode, a raw stream or a mapped .wav file
+ */
+typedef struct
+{
+	FILE *file;						/* raw 16 bit stereo, NULL for .wav */
+	uint8_t *data;					/* mapped samples */
+	int fmt;						/* sample format */
+	uint16_t chls, bytesmpl;
+	size_t pos, samples;			/* frames so far, of total */
+} simio;
+
+/*
+ * pipeline reader stage
+ */
+static size_t sim_read(void *ctx, int16_t *buf, size_t frames)
+{
+	simio *io = ctx;
+	
+	if(io->file)
+		return fread(buf, 2*sizeof(int16_t), frames, io->file);
+	
+	if(frames > io->samples - io->pos)
+		frames = io->samples - io->pos;
+	wav_to_s16(&io->data[io->pos*io->bytesmpl], io->fmt, io->chls, buf,
+		frames);
+	io->pos += frames;
+	return frames;
+}
+
+/*
+ * pipeline writer stage
+ */
+static int sim_write(void *ctx, const int16_t *buf, size_t frames)
+{
+	simio *io = ctx;
+	
+	if(io->file)
+		return fwrite(buf, 2*sizeof(int16_t), frames, io->file) != frames;
+	
+	if(frames > io->samples - io->pos)
+		frames = io->samples - io->pos;
+	wav_from_s16(buf, io->fmt, io->chls, &io->data[io->pos*io->bytesmpl],
+		frames);
+	io->pos += frames;
+	return 0;
+}
+
+/*
+ * render every program, shared by the workers
+ */
+typedef struct
+{
+	const int16_t *pcm;				/* whole input, 16 bit stereo */
+	int32_t samples;
+	const wav_hdr *wh;				/* output header */
+	int fmt;						/* output sample format */
+	int native, analog;				/* options for each program's chain */
+	const char *oname;				/* output name, program number added */
+	atomic_int next;				/* next program to render */
+	atomic_int err;					/* a program failed */
+	atomic_ullong nexec, nidle;		/* over all programs */
+} simall;
+
+/*
+ * out.wav -> out_NN.wav
+ */
+static void sim_progname(char *name, size_t len, const char *oname, int prog)
+{
+	const char *ext = strrchr(oname, '.');
+	
+	if(!ext || strchr(ext, '/'))
+		ext = oname + strlen(oname);
+	snprintf(name, len, "%.*s_%02d%s", (int)(ext - oname), oname, prog, ext);
+}
+
+/*
+ * render one program from the shared input, returns 1 on error
+ */
+static int sim_prog(simall *a, mvchain *c, mvblk *mv, int prog)
+{
+	char name[260];
+	wav_map omap;
+	mvpcm src, dst;
+	
+	/* the spare instance is only used by program changes */
+	midiverb_Init(mv);
+	midiverb_SetProg(mv, prog);
+	if(mvchain_Init(c, a->wh->fmt_smplrate, a->native, a->analog, mv, NULL))
+		return 1;
+	sim_progname(name, sizeof(name), a->oname, prog);
+	if(wav_map_write(&omap, name, a->wh))
+	{
+		fprintf(stderr, "Couldn't map output file %s for write\n", name);
+		return 1;
+	}
+	src = (mvpcm){(uint8_t *)a->pcm, WAV_S16, 2, 2*sizeof(int16_t)};
+	dst = (mvpcm){omap.data, a->fmt, a->wh->fmt_chls, a->wh->fmt_bytesmpl};
+	mvchain_Render(c, &src, &dst, 0, a->samples, NULL, NULL);
+	wav_unmap(&omap);
+	
+	atomic_fetch_add(&a->nexec, mv->nexec);
+	atomic_fetch_add(&a->nidle, mv->nidle);
+	return 0;
+}
+
+/*
+ * worker thread, takes programs until they run out reusing one instance
+ */
+static void *sim_worker(void *arg)
+{
+	simall *a = arg;
+	mvchain *c;
+	mvblk *mv;
+	int prog;
+	
+	c = malloc(sizeof(mvchain));
+	mv = malloc(sizeof(mvblk));
+	if(!c || !mv)
+		atomic_store(&a->err, 1);
+	else
+		while((prog = atomic_fetch_add(&a->next, 1)) <= 62)
+		{
+			if(sim_prog(a, c, mv, prog))
+				atomic_store(&a->err, 1);
+			mvchain_Free(c);
+		}
+	free(mv);
+	free(c);
+	
+	return NULL;
+}
+
+/*
+ * render all 63 programs from one decoded copy of the input, returns 1
+ * on error
+ */
+static int sim_every(const uint8_t *src, int direct, int32_t samples,
+	const wav_hdr *wh, int fmt, int native, int analog, const char *oname,
+	int jobs, int verbose)
+{
+	simall a = {.samples = samples, .wh = wh, .fmt = fmt, .native = native,
+		.analog = analog, .oname = oname};
+	pthread_t tid[63];
+	struct timespec t0, t1;
+	int16_t *pcm = NULL;
+	double secs;
+	int i;
+	
+	/* converted once, 16 bit stereo is shared straight from the mapping */
+	if(direct)
+		a.pcm = (const int16_t *)src;
+	else
+	{
+		if(!(pcm = malloc(2*(size_t)samples*sizeof(int16_t))))
+		{
+			fprintf(stderr, "Out of memory\n");
+			return 1;
+		}
+		wav_to_s16(src, fmt, wh->fmt_chls, pcm, samples);
+		a.pcm = pcm;
+	}
+	atomic_init(&a.next, 0);
+	atomic_init(&a.err, 0);
+	atomic_init(&a.nexec, 0);
+	atomic_init(&a.nidle, 0);
+	
+	if(jobs < 1)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	jobs = jobs < 1 ? 1 : (jobs > 63 ? 63 : jobs);
+	
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(i=0;i<jobs;i++)
+		if(pthread_create(&tid[i], NULL, sim_worker, &a))
+			break;
+	if(!i)
+		sim_worker(&a);
+	jobs = i;
+	for(i=0;i<jobs;i++)
+		pthread_join(tid[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	free(pcm);
+	
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+	fprintf(stdout, "63 programs on %d threads in %.2f s\n", jobs ? jobs : 1,
+		secs);
+	if(verbose)
+		fprintf(stdout, "%llu samples executed, %llu idle\n",
+			(unsigned long long)atomic_load(&a.nexec),
+			(unsigned long long)atomic_load(&a.nidle));
+	
+	if(atomic_load(&a.err))
+	{
+		fprintf(stderr, "Couldn't render every program\n");
+		return 1;
+	}
+	return 0;
+}
 
 int main(int argc, char **argv)
 {
-	int prog = 21;
-	char *iname = "input.wav", *oname = "output.wav";
-	FILE *ifile, *ofile;
-	int16_t in[2], out[2];
+	int prog = 21, prog2 = -1, resume = 0, piped = 0, every = 0, opt;
+	int native = 0, analog = 0, verbose = 0;
+	int fmt, direct, rawin, rawout;
+	char *iname = "input.wav", *oname = "output.wav", cname[256], *end;
+	uint8_t *src = NULL, *dst = NULL;
+	wav_map imap, omap;
 	wav_hdr wh;
-	int32_t samples, scnt;
-	mvblk mv;
+	int32_t samples = 0, start = 0, ckpt = 0;
+	uint32_t rate = 48000;
+	simio rio = {0}, wio = {0};
+	mvpcm pcm, opcm;
+	simckpt k;
+	FILE *stats = stdout;
+	static mvchain c;
+	mvblk mv, mv2;
+	int jobs = 0, err = 0;
+	
+	/*
+	 * -c N checkpoints every N seconds of audio, -r resumes from it,
+	 * -n runs the program at the hardware sample rate, -a adds the
+	 * input anti-alias and output reconstruction filters around it,
+	 * -p reads, processes and writes on separate threads and takes "-"
+	 * for raw 16 bit stereo on stdin / stdout at the -s rate, -e renders
+	 * every program to out_NN.wav on -j threads, one per core by default,
+	 * -v reports the samples executed and skipped as idle silence
+	 */
+	while((opt = getopt(argc, argv, "c:rnaps:ej:v")) != -1)
+	{
+		switch(opt)
+		{
+			case 'r':
+				resume = 1;
+				break;
+			
+			case 'n':
+				native = 1;
+				break;
+			
+			case 'a':
+				analog = 1;
+				break;
+			
+			case 'p':
+				piped = 1;
+				break;
+			
+			case 's':
+				rate = atoi(optarg);
+				break;
+			
+			case 'e':
+				every = 1;
+				break;
+			
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+			
+			case 'v':
+				verbose = 1;
+				break;
+			
+			case 'c':
+				/* whole seconds, at least one */
+				ckpt = strtol(optarg, &end, 10);
+				if(!*end && (ckpt >= 1))
+					break;
+				/* fall through */
+			default:
+				fprintf(stderr, "Usage: %s [-c secs] [-r] [-n] [-a] [-p] "
+					"[-s rate] [-v] [prog [in.wav [out.wav [prog2]]]]\n"
+					"       %s -e [-n] [-a] [-j threads] [-v] "
+					"[in.wav [out.wav]]\n", argv[0], argv[0]);
+				exit(1);
+		}
+	}
+	if((native || analog || piped) && (ckpt || resume))
+	{
+		fprintf(stderr, "Checkpoints don't hold filter state or run "
+			"pipelined, no -n, -a or -p.\n");
+		exit(1);
+	}
+	
+	/* -e takes no programs, only in.wav [out.wav] */
+	if(every && (argc - optind > 2))
+	{
+		fprintf(stderr, "Usage: %s -e [-n] [-a] [-j threads] [-v] "
+			"[in.wav [out.wav]]\n", argv[0]);
+		exit(1);
+	}
+	
+	/* with -e in.wav lands where prog would be without it */
+	argc -= optind - 1 - every;
+	argv += optind - 1 - every;
 	
 	/* override defaults */
-	if(argc > 1)
+	if((argc > 1) && !every)
 		prog = atoi(argv[1]);
 	
 	if(argc > 2)
@@ -26,79 +403,155 @@ int main(int argc, char **argv)
 	
 	if(argc > 3)
 		oname = argv[3];
-		
-	/* open input wav file */
-	if(!(ifile = fopen(iname, "rb")))
+	
+	/* optional program to change to halfway through */
+	if(argc > 4)
+		prog2 = atoi(argv[4]);
+	
+	/* raw streams have no header to size the output from */
+	rawin = !strcmp(iname, "-");
+	rawout = !strcmp(oname, "-");
+	if((rawin || rawout) && !piped)
 	{
-		fprintf(stderr, "Couldn't open input file %s for read\n", iname);
+		fprintf(stderr, "Raw streams need -p.\n");
 		exit(1);
 	}
-	
-	/* get WAV header & check if it's valid */
-	if(fread(&wh, sizeof(wav_hdr), 1, ifile) != 1)
+	if(rawin && (!rawout || (prog2 >= 0)))
 	{
-		fprintf(stderr, "Unexepected EOF in input file.\n");
-		fclose(ifile);
+		fprintf(stderr, "Raw input needs raw output and no prog2.\n");
 		exit(1);
 	}
-	
-	/* check WAV header is valid */
-	if(wav_check_hdr(&wh, 2, 16))
+	if(every && (piped || ckpt || resume || rawout))
 	{
-		fprintf(stderr, "Incorrect input file format.\n");
-		fclose(ifile);
+		fprintf(stderr, "-e renders whole files, no -p, -c or -r.\n");
 		exit(1);
 	}
-	samples = wh.data_sz / wh.fmt_bytesmpl;
 	
-	/* open output file */
-	if(!(ofile = fopen(oname, "wb")))
+	/* checkpoint lives next to the output */
+	snprintf(cname, sizeof(cname), "%s.mvs", oname);
+		
+	if(rawin)
 	{
-		fprintf(stderr, "Couldn't open output file %s for write\n", oname);
-		fclose(ifile);
-		exit(1);
+		fmt = WAV_S16;
+		direct = 1;
+		rio.file = stdin;
+	}
+	else
+	{
+		/* map input wav file, samples are read straight from the mapping */
+		if(wav_map_read(&imap, iname))
+		{
+			fprintf(stderr, "Couldn't map input file %s for read\n", iname);
+			exit(1);
+		}
+		wh = imap.hdr;
+		
+		/* mono or stereo 16 bit, 24 bit or float, output matches the input */
+		if((fmt = wav_conv_fmt(&wh)) < 0)
+		{
+			fprintf(stderr, "Incorrect input file format.\n");
+			wav_unmap(&imap);
+			exit(1);
+		}
+		samples = wh.data_sz / wh.fmt_bytesmpl;
+		rate = wh.fmt_smplrate;
+		
+		/* 16 bit stereo is used in place, the rest converted per block */
+		direct = (fmt == WAV_S16) && (wh.fmt_chls == 2);
+		src = imap.data;
+		rio = (simio){NULL, src, fmt, wh.fmt_chls, wh.fmt_bytesmpl, 0,
+			samples};
 	}
 	
-	/* tack on the wav header */
-	if(fwrite(&wh, sizeof(wav_hdr), 1, ofile) != 1)
+	/* render every program instead, on all cores */
+	if(every)
 	{
-		fprintf(stderr, "Write WAV header to output file failed.\n");
-		fclose(ofile);
-		fclose(ifile);
-		exit(1);
+		err = sim_every(src, direct, samples, &wh, fmt, native, analog, oname,
+			jobs, verbose);
+		wav_unmap(&imap);
+		exit(err);
 	}
 	
 	/* init the midiverb emulator */
 	midiverb_Init(&mv);
 	midiverb_SetProg(&mv, prog);
+	midiverb_Init(&mv2);
+	if(mvchain_Init(&c, rate, native, analog, &mv, &mv2))
+	{
+		fprintf(stderr, "Out of memory\n");
+		err = 1;
+		goto unmap;
+	}
+	c.prog2 = prog2;
+	c.half = samples/2;
 	
-	/* process the audio data one stereo sample at a time */
-	for(scnt=0;scnt<samples;scnt++)
+	/* pick up where the checkpoint was taken in the existing output */
+	if(resume && (((start = load_ckpt(cname, &mv)) < 0) ||
+		(start > samples) || access(oname, W_OK)))
 	{
-		/* get a stereo sample */
-		if(fread(in, sizeof(int16_t), 2, ifile) != 2)
+		fprintf(stderr, "Couldn't resume from checkpoint %s\n", cname);
+		err = 1;
+		goto unmap;
+	}
+	
+	if(rawout)
+	{
+		wio.file = stdout;
+		stats = stderr;
+	}
+	else
+	{
+		/* map output file pre-sized with the wav header, samples kept on resume */
+		if(wav_map_write(&omap, oname, &wh))
 		{
-			fprintf(stderr, "Unexepected EOF in input file.\n");
-			fclose(ofile);
-			fclose(ifile);
-			exit(1);
+			fprintf(stderr, "Couldn't map output file %s for write\n", oname);
+			err = 1;
+			goto unmap;
 		}
+		dst = omap.data;
+		wio = (simio){NULL, dst, fmt, wh.fmt_chls, wh.fmt_bytesmpl, 0,
+			samples};
+	}
+	c.taken = c.given = start;
+	
+	if(piped)
+	{
+		/* file or pipe to file or pipe, a thread per stage */
+		if(mvpipe_Run(sim_read, &rio, sim_dsp, &c, sim_write, &wio))
+		{
+			fprintf(stderr, "Couldn't write output %s\n", oname);
+			err = 1;
+		}
+	}
+	else
+	{
+		/* process the audio data one block at a time */
+		pcm = (mvpcm){src, fmt, wh.fmt_chls, wh.fmt_bytesmpl};
+		opcm = (mvpcm){dst, fmt, wh.fmt_chls, wh.fmt_bytesmpl};
+		k = (simckpt){&omap, cname, ckpt*rate, start + ckpt*rate};
+		mvchain_Render(&c, &pcm, &opcm, start, samples,
+			ckpt ? sim_step : NULL, &k);
 		
-		/* process thru midiverb emulator */
-		midiverb_Proc(&mv, in, out);
-		
-		/* put a stereo sample */
-		if(fwrite(out, sizeof(int16_t), 2, ofile) != 2)
+		/* a finished render leaves nothing to resume, output saved first */
+		if(ckpt || resume)
 		{
-			fprintf(stderr, "Error in output file.\n");
-			fclose(ofile);
-			fclose(ifile);
-			exit(1);
+			wav_map_sync(&omap);
+			remove(cname);
 		}
 	}
 		
+	/* executed vs skipped silence, over both instances */
+	if(verbose)
+		fprintf(stats, "%llu samples executed, %llu idle\n",
+			(unsigned long long)(mv.nexec + mv2.nexec),
+			(unsigned long long)(mv.nidle + mv2.nidle));
+	
 	/* done */
-	fclose(ofile);
-	fclose(ifile);
-	exit(0);
+	if(!rawout)
+		wav_unmap(&omap);
+unmap:
+	mvchain_Free(&c);
+	if(!rawin)
+		wav_unmap(&imap);
+	exit(err);
 }
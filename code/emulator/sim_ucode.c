@@ -12,14 +12,15 @@ int main(int argc, char **argv)
 {
 	int prog = 21;
 	char *uname = "midifverb.bin", *iname = "input.wav", *oname = "output.wav";
-	FILE *ufile, *ifile, *ofile;
+	FILE *ufile;
 #ifdef TRACE
 	FILE *tfile;
 #endif
 	int i, base;
 	uint8_t rom[256];
 	uint16_t ucode[128], instr, op, addr, asum = 0;
-	int16_t dram[16384], stereo[2], adc, ai, acc, sum, sat, acc_out;
+	int16_t dram[16384], *in, *stereo, adc, ai, acc, sum, sat, acc_out;
+	wav_map imap, omap;
 	wav_hdr wh;
 	int32_t samples, scnt;
 	
@@ -75,44 +76,28 @@ int main(int argc, char **argv)
 		dram[i] = 0;
 	}
 	
-	/* open input wav file */
-	if(!(ifile = fopen(iname, "rb")))
+	/* map input wav file */
+	if(wav_map_read(&imap, iname))
 	{
-		fprintf(stderr, "Couldn't open input file %s for read\n", iname);
-		exit(1);
-	}
-	
-	/* get WAV header & check if it's valid */
-	if(fread(&wh, sizeof(wav_hdr), 1, ifile) != 1)
-	{
-		fprintf(stderr, "Unexepected EOF in input file.\n");
-		fclose(ifile);
+		fprintf(stderr, "Couldn't map input file %s for read\n", iname);
 		exit(1);
 	}
+	wh = imap.hdr;
 	
 	/* check WAV header is valid */
 	if(wav_check_hdr(&wh, 2, 16))
 	{
 		fprintf(stderr, "Incorrect input file format.\n");
-		fclose(ifile);
+		wav_unmap(&imap);
 		exit(1);
 	}
 	samples = wh.data_sz / wh.fmt_bytesmpl;
 	
-	/* open output file */
-	if(!(ofile = fopen(oname, "wb")))
+	/* map output file with the wav header on it */
+	if(wav_map_write(&omap, oname, &wh))
 	{
-		fprintf(stderr, "Couldn't open output file %s for write\n", oname);
-		fclose(ifile);
-		exit(1);
-	}
-	
-	/* tack on the wav header */
-	if(fwrite(&wh, sizeof(wav_hdr), 1, ofile) != 1)
-	{
-		fprintf(stderr, "Write WAV header to output file failed.\n");
-		fclose(ofile);
-		fclose(ifile);
+		fprintf(stderr, "Couldn't map output file %s for write\n", oname);
+		wav_unmap(&imap);
 		exit(1);
 	}
 	
@@ -120,17 +105,12 @@ int main(int argc, char **argv)
 	asum = 0;
 	for(scnt=0;scnt<samples;scnt++)
 	{
-		/* get a stereo sample */
-		if(fread(stereo, sizeof(int16_t), 2, ifile) != 2)
-		{
-			fprintf(stderr, "Unexepected EOF in input file.\n");
-			fclose(ofile);
-			fclose(ifile);
-			exit(1);
-		}
+		/* stereo samples in place in the mapped files */
+		in = (int16_t *)imap.data + 2*scnt;
+		stereo = (int16_t *)omap.data + 2*scnt;
 		
 		/* convert stereo to mono and format for Midiverb */
-		adc = ((stereo[0]>>4) + (stereo[1]>>4)) & 0xFFFE;
+		adc = ((in[0]>>4) + (in[1]>>4)) & 0xFFFE;
 		
 #if 1
 		/* run microcode */
@@ -209,15 +189,6 @@ int main(int argc, char **argv)
 		stereo[0] = adc << 3;
 		stereo[1] = adc << 3;
 #endif
-		
-		/* put a stereo sample */
-		if(fwrite(stereo, sizeof(int16_t), 2, ofile) != 2)
-		{
-			fprintf(stderr, "Error in output file.\n");
-			fclose(ofile);
-			fclose(ifile);
-			exit(1);
-		}
 	}
 	
 #if 0
@@ -232,7 +203,7 @@ int main(int argc, char **argv)
 #endif
 	
 	/* done */
-	fclose(ofile);
-	fclose(ifile);
+	wav_unmap(&omap);
+	wav_unmap(&imap);
 	exit(0);
 }
@@ -7,16 +7,24 @@
 #include <math.h>
 #include "midiverb.h"
 
+#ifndef MV_TRACE
+#error "build with -DMV_TRACE"
+#endif
+
+/* trace records buffered between dumps */
+#define TRACESZ 4096
+
 #define max(x,y) ((x)<(y)?(y):(x))
 
 int main(int argc, char **argv)
 {
 	int prog = 21;
 	char *oname = "output.txt";
-	FILE *ofile;
+	FILE *ofile, *tfile;
 	int16_t in[2], out[2];
 	int32_t samples = 10, scnt;
 	mvblk mv;
+	mvtrace tr;
 	
 	/* override defaults */
 	if(argc > 1)
@@ -39,8 +47,14 @@ int main(int argc, char **argv)
 	midiverb_Init(&mv);
 	midiverb_SetProg(&mv, prog);
 	
-	/* set output diagnostics */
-	mv.dfile = ofile;
+	/* set output diagnostics, binary until the end */
+	if(!(tfile = tmpfile()) || mvtrace_Init(&tr, TRACESZ, tfile))
+	{
+		fprintf(stderr, "Couldn't set up trace\n");
+		fclose(ofile);
+		exit(1);
+	}
+	mv.trace = &tr;
 	
 	/* process the audio data one stereo sample at a time */
 	for(scnt=0;scnt<samples;scnt++)
@@ -68,7 +82,13 @@ int main(int argc, char **argv)
 		midiverb_Proc(&mv, in, out);		
 	}
 		
+	/* convert trace to text */
+	mvtrace_Free(&tr);
+	rewind(tfile);
+	mvtrace_Text(tfile, ofile);
+	
 	/* done */
+	fclose(tfile);
 	fclose(ofile);
 	exit(0);
 }
@@ -0,0 +1,167 @@
+/*
+ * wav_conv.c - .WAV sample format conversion
+ * 10-17-26 E. Brombaugh
+ *
+ * Converts blocks between mono or stereo 16 bit, 24 bit or float files and
+ * the interleaved 16 bit stereo the emulator runs on. Mono is duplicated
+ * on the way in and the average of both channels on the way out. The loops
+ * are written as plain per-sample arithmetic without libm calls or branches
+ * so the compiler vectorizes them, which needs -O3.
+ */
+
+#include <string.h>
+#include "wav_conv.h"
+
+/*
+ * which converter handles a file, -1 for none
+ */
+int wav_conv_fmt(const wav_hdr *wh)
+{
+	if((wh->fmt_chls < 1) || (wh->fmt_chls > 2) ||
+		(wh->fmt_bytesmpl != wh->fmt_chls*wh->fmt_smplbits/8))
+		return -1;
+	if((wh->fmt_type == 1) && (wh->fmt_smplbits == 16))
+		return WAV_S16;
+	if((wh->fmt_type == 1) && (wh->fmt_smplbits == 24))
+		return WAV_S24;
+	if((wh->fmt_type == 3) && (wh->fmt_smplbits == 32))
+		return WAV_F32;
+	return -1;
+}
+
+/*
+ * round a float scaled to 16 bits, saturated
+ */
+static inline int16_t wav_f2s(float x)
+{
+	x = x > 32767.0f ? 32767.0f : (x < -32768.0f ? -32768.0f : x);
+	return x + (x < 0 ? -0.5f : 0.5f);
+}
+
+/*
+ * round 24 bits down to 16, saturated
+ */
+static inline int16_t wav_24to16(int32_t x)
+{
+	x = (x + 128) >> 8;
+	return x > 32767 ? 32767 : x;
+}
+
+/*
+ * sign extended 24 bit sample from 3 bytes
+ */
+static inline int32_t wav_get24(const uint8_t *p)
+{
+	return (int32_t)((uint32_t)p[0]<<8 | (uint32_t)p[1]<<16 |
+		(uint32_t)p[2]<<24) >> 8;
+}
+
+/*
+ * file samples to interleaved 16 bit stereo
+ */
+void wav_to_s16(const void *src, int fmt, uint16_t chls, int16_t *dst,
+	size_t frames)
+{
+	const uint8_t *p = src;
+	size_t i;
+	int16_t m;
+	float f;
+	
+	switch(fmt)
+	{
+		case WAV_S16:
+			if(chls == 2)
+				memcpy(dst, src, 4*frames);
+			else
+				for(i=0;i<frames;i++)
+				{
+					memcpy(&m, &p[2*i], sizeof(int16_t));
+					dst[2*i] = dst[2*i+1] = m;
+				}
+			break;
+	
+		case WAV_S24:
+			if(chls == 2)
+				for(i=0;i<2*frames;i++)
+					dst[i] = wav_24to16(wav_get24(&p[3*i]));
+			else
+				for(i=0;i<frames;i++)
+					dst[2*i] = dst[2*i+1] = wav_24to16(wav_get24(&p[3*i]));
+			break;
+	
+		case WAV_F32:
+			if(chls == 2)
+				for(i=0;i<2*frames;i++)
+				{
+					memcpy(&f, &p[4*i], sizeof(float));
+					dst[i] = wav_f2s(f*32768.0f);
+				}
+			else
+				for(i=0;i<frames;i++)
+				{
+					memcpy(&f, &p[4*i], sizeof(float));
+					dst[2*i] = dst[2*i+1] = wav_f2s(f*32768.0f);
+				}
+			break;
+	}
+}
+
+/*
+ * interleaved 16 bit stereo to file samples
+ */
+void wav_from_s16(const int16_t *src, int fmt, uint16_t chls, void *dst,
+	size_t frames)
+{
+	uint8_t *p = dst;
+	size_t i;
+	int32_t x;
+	int16_t m;
+	float f;
+	
+	switch(fmt)
+	{
+		case WAV_S16:
+			if(chls == 2)
+				memcpy(dst, src, 4*frames);
+			else
+				for(i=0;i<frames;i++)
+				{
+					m = (src[2*i] + src[2*i+1]) >> 1;
+					memcpy(&p[2*i], &m, sizeof(int16_t));
+				}
+			break;
+	
+		case WAV_S24:
+			if(chls == 2)
+				for(i=0;i<2*frames;i++)
+				{
+					p[3*i] = 0;
+					p[3*i+1] = src[i];
+					p[3*i+2] = src[i] >> 8;
+				}
+			else
+				for(i=0;i<frames;i++)
+				{
+					x = (src[2*i] + src[2*i+1]) >> 1;
+					p[3*i] = 0;
+					p[3*i+1] = x;
+					p[3*i+2] = x >> 8;
+				}
+			break;
+	
+		case WAV_F32:
+			if(chls == 2)
+				for(i=0;i<2*frames;i++)
+				{
+					f = src[i] * (1.0f/32768.0f);
+					memcpy(&p[4*i], &f, sizeof(float));
+				}
+			else
+				for(i=0;i<frames;i++)
+				{
+					f = (src[2*i] + src[2*i+1]) * (0.5f/32768.0f);
+					memcpy(&p[4*i], &f, sizeof(float));
+				}
+			break;
+	}
+}
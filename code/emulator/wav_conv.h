@@ -0,0 +1,27 @@
+/*
+ * wav_conv.h - .WAV sample format conversion
+ * 10-17-26 E. Brombaugh
+ */
+
+#ifndef __wav_conv__
+#define __wav_conv__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "wav_ops.h"
+
+/* sample formats */
+enum
+{
+	WAV_S16,						/* 16 bit PCM */
+	WAV_S24,						/* packed 24 bit PCM */
+	WAV_F32,						/* 32 bit IEEE float */
+};
+
+int wav_conv_fmt(const wav_hdr *wh);
+void wav_to_s16(const void *src, int fmt, uint16_t chls, int16_t *dst,
+	size_t frames);
+void wav_from_s16(const int16_t *src, int fmt, uint16_t chls, void *dst,
+	size_t frames);
+
+#endif
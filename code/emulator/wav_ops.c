@@ -5,6 +5,10 @@
 
 #include "wav_ops.h"
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 void wav_write_hdr(wav_hdr *wh, uint32_t smpls, uint8_t chls, uint8_t bits,
 				   uint32_t rate)
@@ -70,3 +74,134 @@ uint8_t wav_check_hdr(wav_hdr *wh, uint8_t chls, uint8_t bits)
 
 	return 0;
 }
+
+/*
+ * walk the RIFF chunks of a file in memory, skipping any that aren't fmt or
+ * data, and describe it with a canonical 44 byte header. Extensible formats
+ * are reduced to their subformat. Returns 1 without both chunks.
+ */
+uint8_t wav_parse(const uint8_t *buf, size_t len, wav_hdr *wh, size_t *offs)
+{
+	size_t pos = 12;
+	uint32_t sz;
+	uint8_t found = 0;
+	
+	if((len < 12) || memcmp(buf, "RIFF", 4) || memcmp(&buf[8], "WAVE", 4))
+		return 1;
+	
+	while(pos + 8 <= len)
+	{
+		memcpy(&sz, &buf[pos+4], sizeof(uint32_t));
+		if(!memcmp(&buf[pos], "fmt ", 4))
+		{
+			/* type through bits per sample line up with wav_hdr */
+			if((sz < 16) || (sz > len - pos - 8))
+				return 1;
+			memcpy(&wh->fmt_type, &buf[pos+8], 16);
+			if((wh->fmt_type == 0xFFFE) && (sz >= 26))
+				memcpy(&wh->fmt_type, &buf[pos+32], sizeof(uint16_t));
+			found |= 1;
+		}
+		else if(!memcmp(&buf[pos], "data", 4))
+		{
+			/* streamed files may not have patched the size */
+			*offs = pos + 8;
+			wh->data_sz = sz < len - *offs ? sz : len - *offs;
+			found |= 2;
+		}
+		pos += 8 + (size_t)sz + (sz & 1);
+	}
+	if(found != 3)
+		return 1;
+	
+	memcpy(wh->riff, "RIFF", 4);
+	memcpy(wh->wave, "WAVE", 4);
+	memcpy(wh->fmt, "fmt ", 4);
+	memcpy(wh->data, "data", 4);
+	wh->fmt_sz = 16;
+	if(wh->fmt_bytesmpl)
+		wh->data_sz -= wh->data_sz % wh->fmt_bytesmpl;
+	wh->fsz = 36 + wh->data_sz;
+	
+	return 0;
+}
+
+/*
+ * map an existing file for reading and find its samples.
+ * Returns 1 if it can't be opened, mapped or parsed.
+ */
+int wav_map_read(wav_map *wm, const char *name)
+{
+	struct stat st;
+	size_t offs;
+	
+	if((wm->fd = open(name, O_RDONLY)) < 0)
+		return 1;
+	if(fstat(wm->fd, &st) || (st.st_size < 12))
+	{
+		close(wm->fd);
+		return 1;
+	}
+	wm->len = st.st_size;
+	wm->base = mmap(NULL, wm->len, PROT_READ, MAP_SHARED, wm->fd, 0);
+	if(wm->base == MAP_FAILED)
+	{
+		close(wm->fd);
+		return 1;
+	}
+	madvise(wm->base, wm->len, MADV_SEQUENTIAL);
+	
+	if(wav_parse(wm->base, wm->len, &wm->hdr, &offs))
+	{
+		wav_unmap(wm);
+		return 1;
+	}
+	wm->data = (uint8_t *)wm->base + offs;
+	return 0;
+}
+
+/*
+ * map a file for writing sized for the header's data and store the header.
+ * Samples already in an existing file are kept. Returns 1 on failure.
+ */
+int wav_map_write(wav_map *wm, const char *name, const wav_hdr *wh)
+{
+	if((wm->fd = open(name, O_RDWR | O_CREAT, 0644)) < 0)
+		return 1;
+	wm->len = sizeof(wav_hdr) + wh->data_sz;
+	if(ftruncate(wm->fd, wm->len))
+	{
+		close(wm->fd);
+		return 1;
+	}
+	wm->base = mmap(NULL, wm->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+		wm->fd, 0);
+	if(wm->base == MAP_FAILED)
+	{
+		close(wm->fd);
+		return 1;
+	}
+	madvise(wm->base, wm->len, MADV_SEQUENTIAL);
+	wm->hdr = *wh;
+	memcpy(wm->base, wh, sizeof(wav_hdr));
+	wm->data = (uint8_t *)wm->base + sizeof(wav_hdr);
+	
+	return 0;
+}
+
+/*
+ * wait for everything written so far to reach the file
+ */
+int wav_map_sync(wav_map *wm)
+{
+	return msync(wm->base, wm->len, MS_SYNC);
+}
+
+/*
+ * release a mapping
+ */
+void wav_unmap(wav_map *wm)
+{
+	munmap(wm->base, wm->len);
+	close(wm->fd);
+}